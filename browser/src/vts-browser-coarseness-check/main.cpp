@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <random>
+#include <iostream>
+#include <vts-browser/math.hpp>
+
+#include "../vts-libbrowser/coarseness.hpp"
+
+// compares the coarseness kernel with the reference implementation
+//   on randomized cameras and node boxes
+// returns non-zero if any result is out of the tolerance
+
+using namespace vts;
+
+namespace
+{
+
+// same tolerance as the comparison in debug builds of the library
+const double Tolerance = 1e-2;
+
+const double EarthRadius = 6378000;
+
+uint32 failures = 0;
+
+bool compare(double result, double reference)
+{
+    if (std::isnan(result))
+        return false; // invalid corners must be ignored
+    if (std::isinf(reference) || std::isinf(result))
+        return result == reference;
+    return std::abs(result - reference)
+            <= Tolerance * std::max(reference, 1.0);
+}
+
+void check(const char *what, uint32 index, double result, double reference)
+{
+    if (compare(result, reference))
+        return;
+    if (failures++ < 10)
+    {
+        std::cerr << what << " " << index << ": kernel " << result
+                  << " differs from reference " << reference << std::endl;
+    }
+}
+
+struct Camera
+{
+    mat4 viewProj;
+    vec3 position;
+    vec3 perpendicular;
+    uint32 windowHeight;
+
+    Camera(const vec3 &eye, const vec3 &target, const vec3 &up,
+           double fov, double near, double far, uint32 width, uint32 height)
+        : position(eye), windowHeight(height)
+    {
+        viewProj = perspectiveMatrix(fov, double(width) / height, near, far)
+                * lookAt(eye, target, up);
+        // same as in the map renderer
+        vec3 forward = normalize(target - eye);
+        perpendicular = normalize(cross(cross(up, forward), forward));
+    }
+
+    double kernel(const vec3 corners[8], double texelSize) const
+    {
+        return coarsenessKernel(CoarsenessCamera(viewProj,
+            perpendicular, position, windowHeight), corners, texelSize);
+    }
+
+    double reference(const vec3 corners[8], double texelSize) const
+    {
+        return coarsenessReference(viewProj, perpendicular,
+                                   windowHeight, corners, texelSize);
+    }
+};
+
+// cameras at altitudes from 100 m to 10 000 km above a planet,
+//   looking around, with boxes of various sizes near the view
+void randomized(uint32 count)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> uni(-1, 1);
+    auto rnd = [&]() { return vec3(uni(gen), uni(gen), uni(gen)); };
+    for (uint32 k = 0; k < count; k++)
+    {
+        vec3 dir = normalize(rnd());
+        double alt = std::pow(10, 2 + 2.5 * (uni(gen) + 1));
+        vec3 eye = dir * (EarthRadius + alt);
+        vec3 target = dir * EarthRadius + rnd() * alt;
+        vec3 forward = target - eye;
+        if (length(forward) < 1e-3 * alt
+                || length(cross(forward, dir)) < 1e-6 * alt)
+            continue;
+        Camera cam(eye, target, dir, 30 + 60 * (uni(gen) + 1) / 2,
+                   alt * 0.1, alt * 100, 1920, 1080);
+        double size = alt * std::pow(10, uni(gen));
+        vec3 center = target + rnd() * alt;
+        vec3 corners[8];
+        for (uint32 i = 0; i < 8; i++)
+            corners[i] = center + vec3(i & 1 ? size : -size,
+                i & 2 ? size : -size, i & 4 ? size : -size) * 0.5;
+        double texelSize = size / 256;
+        check("random", k, cam.kernel(corners, texelSize),
+              cam.reference(corners, texelSize));
+    }
+}
+
+// a corner placed so that its texel starts exactly at the camera,
+//   the kernel computes 0 / 0 there and must clamp the lane to zero
+void invalidCorners()
+{
+    Camera cam(vec3(0, 0, 0), vec3(0, 0, -10), vec3(0, 1, 0),
+               60, 0.1, 1000, 1920, 1080);
+    double texelSize = 2;
+    vec3 invalid = cam.position + cam.perpendicular * texelSize * 0.5;
+    vec3 corners[8];
+    for (uint32 i = 0; i < 8; i++)
+        corners[i] = invalid;
+
+    // all corners invalid
+    double all = cam.kernel(corners, texelSize);
+    if (all != 0)
+    {
+        failures++;
+        std::cerr << "invalid corners: kernel " << all
+                  << " instead of zero" << std::endl;
+    }
+
+    // a single invalid corner among valid ones
+    for (uint32 i = 1; i < 8; i++)
+        corners[i] = vec3(i & 1 ? 5 : -5, i & 2 ? 5 : -5, -20 - 5.0 * i);
+    check("mixed", 0, cam.kernel(corners, texelSize),
+          cam.reference(corners, texelSize));
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    uint32 count = 100000;
+    if (argc > 1)
+        count = std::stoul(argv[1]);
+    randomized(count);
+    invalidCorners();
+    if (failures > 0)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
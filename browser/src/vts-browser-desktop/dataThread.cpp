@@ -76,7 +76,7 @@ void DataThread::run()
         map->dataTick();
         uint32 timeFrameEnd = SDL_GetTicks();
         timing = timeFrameEnd - timeFrameStart;
-        microSleep(100000);
+        map->dataWaitForWork(0.1);
     }
     map->dataFinalize();
     SDL_GL_DeleteContext(context);
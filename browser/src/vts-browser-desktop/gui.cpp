@@ -856,15 +856,33 @@ public:
                 S("RAM memory:", s.currentRamMemUseKB / 1024, " MB");
                 S("Node meta updates:", s.currentNodeMetaUpdates, "");
                 S("Node draw updates:", s.currentNodeDrawsUpdates, "");
+                S("Nodes swept:", s.currentNodesSwept, "");
+                S("Nodes cleared:", s.nodesCleared, "");
+                S("Frames reused:", s.framesReused, "");
                 S("Preparing:", s.resourcesPreparing, "");
                 S("Downloading:", s.resourcesDownloading, "");
+                S("Fetch queued:", s.resourcesFetchQueued, "");
+                S("Decoding:", s.resourcesDecoding, "");
+                S("Data tick time:", s.currentDataTickMicroseconds / 1000, " ms");
+                S("Data deferred:", s.currentDataTickDeferred, "");
+                S("Cache queue:", s.cacheWriteQueueDepth, "");
+                S("Cache latency:", s.cacheWriteLatencyMicroseconds / 1000, " ms");
+                S("Cache disk use:", s.cacheDiskUseMB, " MB");
                 S("Downloaded:", s.resourcesDownloaded, "");
                 S("Disk loaded:", s.resourcesDiskLoaded, "");
+                S("Decoded loaded:", s.resourcesDecodedLoaded, "");
                 S("Active:", s.resourcesActive, "");
                 S("Processed:", s.resourcesProcessed, "");
                 S("Created:", s.resourcesCreated, "");
                 S("Released:", s.resourcesReleased, "");
                 S("Failed:", s.resourcesFailed, "");
+                S("Cancelled:", s.resourcesCancelled, "");
+                S("Revalidated:", s.resourcesRevalidated, "");
+                S("Cache dropped:", s.cacheWritesDropped, "");
+                S("Cache evicted:", s.cacheEntriesEvicted, "");
+                S("Cache hits:", s.cacheLookupHits, "");
+                S("Cache misses:", s.cacheLookupMisses, "");
+                S("Cache false pos.:", s.cacheLookupFalsePositives, "");
 
                 nk_tree_pop(&ctx);
             }
@@ -178,8 +178,12 @@ int main()
             }
         }
 
-        // update downloads
-        vtsMapDataTick(map);
+        // update downloads (only when there is something to do)
+        if (vtsMapDataWaitForWork(map, 0))
+        {
+            check();
+            vtsMapDataTick(map);
+        }
         check();
 
         // update navigation etc.
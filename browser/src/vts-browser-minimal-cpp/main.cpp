@@ -150,8 +150,9 @@ int main(int, char *[])
             }
         }
 
-        // update downloads
-        map->dataTick();
+        // update downloads (only when there is something to do)
+        if (map->dataWaitForWork(0))
+            map->dataTick();
 
         // update navigation etc.
         uint32 currentRenderTime = SDL_GetTicks();
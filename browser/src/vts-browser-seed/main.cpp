@@ -0,0 +1,283 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <vts-browser/map.hpp>
+#include <vts-browser/options.hpp>
+#include <vts-browser/log.hpp>
+#include <vts-browser/fetcher.hpp>
+#include <vts-browser/seed.hpp>
+#include <vts-browser/boostProgramOptions.hpp>
+
+namespace po = boost::program_options;
+
+namespace
+{
+
+struct SeedOptions
+{
+    std::string mapConfig;
+    std::string auth;
+    std::string sri;
+    std::string extents;
+    std::string polygon;
+    uint32 lodMin;
+    uint32 lodMax;
+    bool estimate;
+
+    SeedOptions() : lodMin(0), lodMax(15), estimate(false)
+    {}
+};
+
+std::vector<double> parseNumbers(const std::string &value)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, value, boost::is_any_of(", ;"),
+                 boost::token_compress_on);
+    std::vector<double> r;
+    for (auto &it : parts)
+    {
+        if (!it.empty())
+            r.push_back(boost::lexical_cast<double>(it));
+    }
+    return r;
+}
+
+bool programOptions(SeedOptions &seedOptions,
+                    vts::MapCreateOptions &createOptions,
+                    vts::MapOptions &mapOptions,
+                    vts::FetcherOptions &fetcherOptions,
+                    int argc, char *argv[])
+{
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help", "Show this help.")
+            ("url",
+                po::value<std::string>(&seedOptions.mapConfig),
+                "Mapconfig URL."
+            )
+            ("auth,a",
+                po::value<std::string>(&seedOptions.auth),
+                "Authentication url."
+            )
+            ("sri,s",
+                po::value<std::string>(&seedOptions.sri),
+                "SRI url."
+            )
+            ("extents,e",
+                po::value<std::string>(&seedOptions.extents),
+                "Region to download in navigation srs.\n"
+                "Format: llx,lly,urx,ury"
+            )
+            ("polygon",
+                po::value<std::string>(&seedOptions.polygon),
+                "Bounding polygon in navigation srs, "
+                "the extents default to its bounding box.\n"
+                "Format: x,y;x,y;x,y..."
+            )
+            ("lodMin",
+                po::value<uint32>(&seedOptions.lodMin)
+                ->default_value(seedOptions.lodMin),
+                "Coarsest lod to download."
+            )
+            ("lodMax",
+                po::value<uint32>(&seedOptions.lodMax)
+                ->default_value(seedOptions.lodMax),
+                "Finest lod to download."
+            )
+            ("estimate",
+                po::value<bool>(&seedOptions.estimate)
+                ->default_value(seedOptions.estimate)
+                ->implicit_value(!seedOptions.estimate),
+                "Only estimate the size of the region, "
+                "download metatiles and a few samples of the data."
+            )
+            ;
+
+    po::positional_options_description popts;
+    popts.add("url", 1);
+
+    vts::optionsConfigLog(desc);
+    vts::optionsConfigCreateOptions(desc, &createOptions);
+    vts::optionsConfigMapOptions(desc, &mapOptions);
+    vts::optionsConfigFetcherOptions(desc, &fetcherOptions);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).
+          options(desc).positional(popts).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || seedOptions.mapConfig.empty()
+            || (seedOptions.extents.empty() && seedOptions.polygon.empty()))
+    {
+        std::cout << "Usage: " << argv[0] << " [options] [--]"
+                  << " url (--extents | --polygon)"
+                  << std::endl << desc << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<vts::SeedTask> createTask(const SeedOptions &seedOptions)
+{
+    std::vector<std::array<double, 2>> polygon;
+    {
+        std::vector<double> p = parseNumbers(seedOptions.polygon);
+        if (p.size() % 2 != 0)
+            throw std::runtime_error("Polygon has odd number of coordinates");
+        for (uint32 i = 0; i < p.size(); i += 2)
+            polygon.push_back({ p[i], p[i + 1] });
+    }
+
+    double extents[4];
+    if (!seedOptions.extents.empty())
+    {
+        std::vector<double> e = parseNumbers(seedOptions.extents);
+        if (e.size() != 4)
+            throw std::runtime_error("Extents must have 4 coordinates");
+        std::copy(e.begin(), e.end(), extents);
+    }
+    else
+    {
+        if (polygon.size() < 3)
+            throw std::runtime_error("Polygon must have at least 3 points");
+        extents[0] = extents[2] = polygon[0][0];
+        extents[1] = extents[3] = polygon[0][1];
+        for (auto &it : polygon)
+        {
+            extents[0] = std::min(extents[0], it[0]);
+            extents[1] = std::min(extents[1], it[1]);
+            extents[2] = std::max(extents[2], it[0]);
+            extents[3] = std::max(extents[3], it[1]);
+        }
+    }
+
+    auto task = std::make_shared<vts::SeedTask>(extents,
+                        seedOptions.lodMin, seedOptions.lodMax);
+    task->polygon = polygon;
+    task->estimateOnly = seedOptions.estimate;
+    return task;
+}
+
+void printProgress(const vts::SeedTask &task)
+{
+    std::printf("nodes: %u, resources: %u / %u (%u cached, %u failed), "
+                "data: %.1f MB / estimated %.1f MB\n",
+                task.nodesVisited, task.resourcesDone, task.resourcesTotal,
+                task.resourcesCached, task.resourcesFailed,
+                task.bytesDone / 1048576.0, task.bytesEstimated / 1048576.0);
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        vts::setLogThreadName("main");
+        vts::setLogFile("vts-browser-seed.log");
+
+        vts::MapCreateOptions createOptions;
+        createOptions.clientId = "vts-browser-seed";
+        vts::MapOptions mapOptions;
+        // all the data goes to the disk cache,
+        //   the downloads are limited only by the fetcher
+        mapOptions.maxConcurrentDownloads = 200;
+        mapOptions.maxResourceProcessesPerTick = -1;
+        vts::FetcherOptions fetcherOptions;
+        fetcherOptions.maxHostConnections = 50;
+        fetcherOptions.maxTotalConnections = 200;
+        SeedOptions seedOptions;
+        if (!programOptions(seedOptions, createOptions, mapOptions,
+                            fetcherOptions, argc, argv))
+            return 0;
+        if (createOptions.disableCache)
+            throw std::runtime_error("Seeding requires the disk cache");
+        std::shared_ptr<vts::SeedTask> task = createTask(seedOptions);
+
+        vts::Map map(createOptions);
+        map.options() = mapOptions;
+
+        // resource processing in separate thread
+        std::atomic<bool> stop(false);
+        std::thread data([&]() {
+            vts::setLogThreadName("data");
+            map.dataInitialize(vts::Fetcher::create(fetcherOptions));
+            while (!stop)
+            {
+                map.dataTick();
+                map.dataWaitForWork(0.1);
+            }
+            map.dataFinalize();
+        });
+
+        map.renderInitialize();
+        map.setMapConfigPath(seedOptions.mapConfig,
+                             seedOptions.auth, seedOptions.sri);
+
+        bool started = false;
+        auto lastPrint = std::chrono::steady_clock::now();
+        while (!task->done)
+        {
+            map.renderTickPrepare(0.01);
+            if (!started && map.getMapConfigReady())
+            {
+                map.seed(task);
+                started = true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (started && now - lastPrint > std::chrono::seconds(1))
+            {
+                printProgress(*task);
+                lastPrint = now;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        printProgress(*task);
+
+        map.renderFinalize();
+        stop = true;
+        data.join();
+        return task->resourcesFailed > 0 ? 2 : 0;
+    }
+    catch(const std::exception &e)
+    {
+        std::stringstream s;
+        s << "Exception <" << e.what() << ">";
+        vts::log(vts::LogLevel::err4, s.str());
+        return 1;
+    }
+}
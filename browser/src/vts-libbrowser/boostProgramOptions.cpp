@@ -109,11 +109,58 @@ void optionsConfigCreateOptions(
         ->default_value(opts->cachePath),
         "Path to a directory where all downloaded resources are cached.")
 
+    ((section + "decodeThreads").c_str(),
+        po::value<uint32>(&opts->decodeThreads)
+        ->default_value(opts->decodeThreads),
+        "Number of threads dedicated to decoding resources.")
+
+    ((section + "cacheWriteQueueKB").c_str(),
+        po::value<uint32>(&opts->cacheWriteQueueKB)
+        ->default_value(opts->cacheWriteQueueKB),
+        "Memory limit (in KB) of the queue of writes into the disk cache. "
+        "Pack files are synced once per batch of writes, "
+        "the per-file cache is never synced. "
+        "Zero to write into the cache directly.")
+
+    ((section + "cacheMaxSizeMB").c_str(),
+        po::value<uint32>(&opts->cacheMaxSizeMB)
+        ->default_value(opts->cacheMaxSizeMB),
+        "Maximum size (in MB) of the disk cache. "
+        "Least recently used entries are evicted. "
+        "Zero for unlimited size.")
+
     ((section + "disableCache").c_str(),
         po::value<bool>(&opts->disableCache)
         ->default_value(opts->disableCache)
         ->implicit_value(!opts->disableCache),
         "Set to yes to completly disable the cache.")
+
+    ((section + "packCacheFiles").c_str(),
+        po::value<bool>(&opts->packCacheFiles)
+        ->default_value(opts->packCacheFiles)
+        ->implicit_value(!opts->packCacheFiles),
+        "Set to yes to store the cache in a few append-only pack files.")
+
+    ((section + "cacheCompression").c_str(),
+        po::value<bool>(&opts->cacheCompression)
+        ->default_value(opts->cacheCompression)
+        ->implicit_value(!opts->cacheCompression),
+        "Set to yes to compress the entries in the disk cache.")
+
+    ((section + "cacheDecodedResources").c_str(),
+        po::value<bool>(&opts->cacheDecodedResources)
+        ->default_value(opts->cacheDecodedResources)
+        ->implicit_value(!opts->cacheDecodedResources),
+        "Set to yes to store decoded meshes and textures "
+        "in the disk cache.")
+
+    ((section + "cacheWriteQueueDropOnFull").c_str(),
+        po::value<bool>(&opts->cacheWriteQueueDropOnFull)
+        ->default_value(opts->cacheWriteQueueDropOnFull)
+        ->implicit_value(!opts->cacheWriteQueueDropOnFull),
+        "Set to yes to drop cache writes when the write queue stays full "
+        "for a few milliseconds, no to block the downloads until "
+        "there is space.")
     ;
 }
 
@@ -152,6 +199,12 @@ void optionsConfigMapOptions(
         ->default_value(opts->maxResourceProcessesPerTick),
         "Maximum number of resources processed per dataTick.")
 
+    ((section + "maxDataTickMilliseconds").c_str(),
+        po::value<double>(&opts->maxDataTickMilliseconds)
+        ->default_value(opts->maxDataTickMilliseconds),
+        "Time budget for single dataTick, in milliseconds. "
+        "Zero to limit the dataTick by maxResourceProcessesPerTick.")
+
     ((section + "maxFetchRedirections").c_str(),
         po::value<uint32>(&opts->maxFetchRedirections)
         ->default_value(opts->maxFetchRedirections),
@@ -167,6 +220,18 @@ void optionsConfigMapOptions(
         ->default_value(opts->fetchFirstRetryTimeOffset),
         "Delay in seconds for first resource download retry.")
 
+    ((section + "fetchCancelStaleTicks").c_str(),
+        po::value<uint32>(&opts->fetchCancelStaleTicks)
+        ->default_value(opts->fetchCancelStaleTicks),
+        "Number of render ticks after which downloads of resources, "
+        "that are no longer needed, are cancelled. Zero to never cancel.")
+
+    ((section + "maxTraverseClearingPerTick").c_str(),
+        po::value<uint32>(&opts->maxTraverseClearingPerTick)
+        ->default_value(opts->maxTraverseClearingPerTick),
+        "Maximum number of traverse nodes checked for staleness "
+        "per render tick. Zero to check all nodes every tick.")
+
     ((section + "traverseModeSurfaces").c_str(),
         po::value<TraverseMode>(&opts->traverseModeSurfaces)
         ->default_value(opts->traverseModeSurfaces),
@@ -182,6 +247,13 @@ void optionsConfigMapOptions(
         "hierarchical\n"
         "flat\n"
         "balanced")
+
+    ((section + "enableFrameReuse").c_str(),
+        po::value<bool>(&opts->enableFrameReuse)
+        ->default_value(opts->enableFrameReuse)
+        ->implicit_value(!opts->enableFrameReuse),
+        "Set to yes to reuse the draws of the previous frame "
+        "when nothing has changed.")
     ;
 }
 
@@ -299,6 +371,34 @@ void optionsConfigFetcherOptions(
         po::value<sint32>(&opts->pipelining)
         ->default_value(opts->pipelining),
         "HTTP pipelining mode.")
+
+    ((section + "adaptiveConcurrency").c_str(),
+        po::value<bool>(&opts->adaptiveConcurrency)
+        ->default_value(opts->adaptiveConcurrency)
+        ->implicit_value(!opts->adaptiveConcurrency),
+        "Adjust concurrent connections to each host "
+        "based on its latency and errors.")
+
+    ((section + "maxActiveTransfers").c_str(),
+        po::value<uint32>(&opts->maxActiveTransfers)
+        ->default_value(opts->maxActiveTransfers),
+        "Limit of transfers started at once, the others wait "
+        "and are started in order of their priority, 0 = unlimited.")
+
+    ((section + "recordPath").c_str(),
+        po::value<std::string>(&opts->recordPath),
+        "Record all downloads into this archive file.")
+
+    ((section + "replayPath").c_str(),
+        po::value<std::string>(&opts->replayPath),
+        "Serve all downloads from this previously recorded archive "
+        "instead of the network.")
+
+    ((section + "replayLatencyScale").c_str(),
+        po::value<double>(&opts->replayLatencyScale)
+        ->default_value(opts->replayLatencyScale),
+        "Multiplier of the recorded latencies during replay, "
+        "0 to serve the replies immediately.")
     ;
 }
 
@@ -36,7 +36,7 @@ using vtslibs::registry::BoundLayer;
 
 BoundInfo::BoundInfo(const vtslibs::registry::BoundLayer &bl,
                                 const std::string &url)
-    : BoundLayer(bl)
+    : BoundLayer(bl), keySource(newResourceKeySource())
 {
     urlExtTex.parse(convertPath(this->url, url));
     if (metaUrl)
@@ -55,7 +55,7 @@ BoundInfo::BoundInfo(const vtslibs::registry::BoundLayer &bl,
 BoundParamInfo::BoundParamInfo(const View::BoundLayerParams &params)
     : View::BoundLayerParams(params),
       bound(nullptr), transparent(false),
-      orig(0), depth(0)
+      orig(0), subMesh(0), depth(0)
 {}
 
 mat3f BoundParamInfo::uvMatrix() const
@@ -98,6 +98,7 @@ Validity BoundParamInfo::prepare(const NodeInfo &nodeInfo, MapImpl *impl,
 
     orig = UrlTemplate::Vars(nodeInfo.nodeId(),
                                 local(nodeInfo), subMeshIndex);
+    subMesh = subMeshIndex;
 
     depth = std::max(nodeInfo.nodeId().lod - bound->lodRange.max, 0);
 
@@ -143,8 +144,10 @@ Validity BoundParamInfo::prepareDepth(MapImpl *impl, double priority)
         v.tileId.y &= ~255;
         v.localId.x &= ~255;
         v.localId.y &= ~255;
-        std::string boundName = bound->urlMeta(v);
-        std::shared_ptr<BoundMetaTile> bmt = impl->getBoundMetaTile(boundName);
+        std::shared_ptr<BoundMetaTile> bmt = impl->getBoundMetaTile(
+                    ResourceKey(bound->keySource,
+                                ResourceKey::Slot::BoundMetaTile, v.tileId),
+                    bound->urlMeta, v);
         bmt->updatePriority(priority);
         switch (impl->getResourceValidity(bmt))
         {
@@ -166,7 +169,11 @@ Validity BoundParamInfo::prepareDepth(MapImpl *impl, double priority)
 
     transparent = bound->isTransparent || (!!alpha && *alpha < 1);
 
-    textureColor = impl->getTexture(bound->urlExtTex(vars));
+    textureColor = impl->getTexture(
+                ResourceKey(bound->keySource,
+                            ResourceKey::Slot::ExternalTexture,
+                            vars.tileId, subMesh),
+                bound->urlExtTex, vars);
     textureColor->updatePriority(priority);
     textureColor->availTest = bound->availability;
     switch (impl->getResourceValidity(textureColor))
@@ -180,7 +187,11 @@ Validity BoundParamInfo::prepareDepth(MapImpl *impl, double priority)
     }
     if (!watertight)
     {
-        textureMask = impl->getTexture(bound->urlMask(vars));
+        textureMask = impl->getTexture(
+                    ResourceKey(bound->keySource,
+                                ResourceKey::Slot::MaskTexture,
+                                vars.tileId, subMesh),
+                    bound->urlMask, vars);
         textureMask->updatePriority(priority);
         switch (impl->getResourceValidity(textureMask))
         {
@@ -26,6 +26,7 @@
 
 #include <cstring>
 #include <map>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <dbglog/dbglog.hpp>
 
@@ -86,29 +87,62 @@ dataMapType &dataMap()
 
 } // namespace
 
-Buffer::Buffer() : data_(nullptr), size_(0)
+Buffer::Buffer() : data_(nullptr), size_(0), external_(false)
 {}
 
-Buffer::Buffer(uint32 size) : data_(nullptr), size_(size)
+Buffer::Buffer(uint32 size) : data_(nullptr), size_(size), external_(false)
 {
     allocate(size);
 }
 
-Buffer::Buffer(const std::string &str) : data_(nullptr), size_(0)
+Buffer::Buffer(const std::string &str) : data_(nullptr), size_(0),
+    external_(false)
 {
     allocate(str.length());
     memcpy(data_, str.data(), size_);
 }
 
+Buffer::Buffer(char *data, uint32 size, std::shared_ptr<void> owner) :
+    data_(data), size_(size), owner_(std::move(owner)), external_(true)
+{}
+
+Buffer::Buffer(std::string &&str) : data_(nullptr), size_(0),
+    external_(false)
+{
+    if (str.empty())
+        return;
+    // the string object is moved to heap so that the pointer stays valid
+    auto s = std::make_shared<std::string>(std::move(str));
+    data_ = &(*s)[0];
+    size_ = s->size();
+    owner_ = std::move(s);
+    external_ = true;
+}
+
+Buffer::Buffer(std::vector<char> &&vec) : data_(nullptr), size_(0),
+    external_(false)
+{
+    if (vec.empty())
+        return;
+    auto v = std::make_shared<std::vector<char>>(std::move(vec));
+    data_ = v->data();
+    size_ = v->size();
+    owner_ = std::move(v);
+    external_ = true;
+}
+
 Buffer::~Buffer()
 {
     this->free();
 }
 
-Buffer::Buffer(Buffer &&other) noexcept : data_(other.data_), size_(other.size_)
+Buffer::Buffer(Buffer &&other) noexcept : data_(other.data_),
+    size_(other.size_), owner_(std::move(other.owner_)),
+    external_(other.external_)
 {
     other.data_ = nullptr;
     other.size_ = 0;
+    other.external_ = false;
 }
 
 Buffer &Buffer::operator = (Buffer &&other) noexcept
@@ -118,8 +152,11 @@ Buffer &Buffer::operator = (Buffer &&other) noexcept
     this->free();
     size_ = other.size_;
     data_ = other.data_;
+    owner_ = std::move(other.owner_);
+    external_ = other.external_;
     other.data_ = nullptr;
     other.size_ = 0;
+    other.external_ = false;
     return *this;
 }
 
@@ -130,6 +167,13 @@ Buffer Buffer::copy() const
     return r;
 }
 
+Buffer Buffer::share() const
+{
+    if (!owner_)
+        return copy();
+    return Buffer(data_, size_, owner_);
+}
+
 std::string Buffer::str() const
 {
     return std::string(data_, size_);
@@ -148,6 +192,14 @@ void Buffer::allocate(uint32 size)
 
 void Buffer::resize(uint32 size)
 {
+    if (external_)
+    {
+        // move the content into own memory
+        Buffer b(size);
+        memcpy(b.data_, data_, std::min(size, size_));
+        *this = std::move(b);
+        return;
+    }
     char *tmp = (char*)realloc(data_, size);
     if (!tmp)
     {
@@ -161,7 +213,13 @@ void Buffer::resize(uint32 size)
 
 void Buffer::free()
 {
-    ::free(data_);
+    if (external_)
+    {
+        owner_.reset();
+        external_ = false;
+    }
+    else
+        ::free(data_);
     data_ = nullptr;
     size_ = 0;
 }
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "coarseness.hpp"
+
+namespace vts
+{
+
+CoarsenessCamera::CoarsenessCamera() : windowHeight(0)
+{
+    position.setZero();
+    rowY.setZero();
+    rowW.setZero();
+    up.setZero();
+}
+
+CoarsenessCamera::CoarsenessCamera(const mat4 &viewProj,
+        const vec3 &perpendicular, const vec3 &position,
+        uint32 windowHeight) :
+    position(position), windowHeight(windowHeight)
+{
+    vec4 ry = viewProj.row(1).transpose();
+    vec4 rw = viewProj.row(3).transpose();
+    rowY = vec4f(ry[0], ry[1], ry[2], ry.dot(vec3to4(position, 1)));
+    rowW = vec4f(rw[0], rw[1], rw[2], rw.dot(vec3to4(position, 1)));
+    up = vec2f(dot(vec4to3(ry), perpendicular),
+               dot(vec4to3(rw), perpendicular));
+}
+
+double coarsenessKernel(const CoarsenessCamera &camera,
+                        const vec3 corners[8], double texelSize)
+{
+    typedef Eigen::Array<float, 8, 1> lanes;
+    lanes x, y, z;
+    for (uint32 i = 0; i < 8; i++)
+    {
+        vec3 c = corners[i] - camera.position;
+        x[i] = c[0];
+        y[i] = c[1];
+        z[i] = c[2];
+    }
+    const vec4f &ry = camera.rowY;
+    const vec4f &rw = camera.rowW;
+    lanes cy = x * ry[0] + y * ry[1] + z * ry[2] + ry[3];
+    lanes cw = x * rw[0] + y * rw[1] + z * rw[2] + rw[3];
+    float hy = camera.up[0] * texelSize * 0.5;
+    float hw = camera.up[1] * texelSize * 0.5;
+    lanes len = ((cy + hy) / (cw + hw) - (cy - hy) / (cw - hw)).abs();
+    len = (len == len).select(len, 0); // ignore invalid corners
+    return len.maxCoeff() * camera.windowHeight * 0.5;
+}
+
+double coarsenessReference(const mat4 &viewProj, const vec3 &perpendicular,
+                           uint32 windowHeight,
+                           const vec3 corners[8], double texelSize)
+{
+    // test the value on all corners of node bounding box
+    double result = 0;
+    vec3 up = perpendicular * texelSize;
+    for (uint32 i = 0; i < 8; i++)
+    {
+        vec3 c1 = corners[i] - up * 0.5;
+        vec3 c2 = c1 + up;
+        c1 = vec4to3(viewProj * vec3to4(c1, 1), true);
+        c2 = vec4to3(viewProj * vec3to4(c2, 1), true);
+        double len = std::abs(c2[1] - c1[1]) * windowHeight * 0.5;
+        result = std::max(result, len);
+    }
+    return result;
+}
+
+} // namespace vts
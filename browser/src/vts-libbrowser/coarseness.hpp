@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COARSENESS_H_qwpoesdfkj
+#define COARSENESS_H_qwpoesdfkj
+
+#include "include/vts-browser/math.hpp"
+
+namespace vts
+{
+
+// inputs of the coarseness kernel that are the same for the whole frame
+struct CoarsenessCamera
+{
+    vec3 position;
+    // rows of viewProj for positions relative to the camera,
+    //   with the projection of the perpendicular unit vector
+    vec4f rowY;
+    vec4f rowW;
+    vec2f up;
+    uint32 windowHeight;
+
+    CoarsenessCamera();
+    CoarsenessCamera(const mat4 &viewProj, const vec3 &perpendicular,
+                     const vec3 &position, uint32 windowHeight);
+};
+
+// projected size (in pixels) of a texel on the eight corners
+//   of a node bounding box, the largest one is returned
+// all corners are computed at once, in float
+// corners that cannot be projected are ignored
+double coarsenessKernel(const CoarsenessCamera &camera,
+                        const vec3 corners[8], double texelSize);
+
+// the original implementation, one corner at a time, in double
+//   the kernel is compared with it
+double coarsenessReference(const mat4 &viewProj, const vec3 &perpendicular,
+                           uint32 windowHeight,
+                           const vec3 corners[8], double texelSize);
+
+} // namespace vts
+
+#endif
@@ -0,0 +1,531 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <dbglog/dbglog.hpp>
+
+#include "../include/vts-browser/fetcher.hpp"
+#include "../include/vts-browser/log.hpp"
+#include "../resources/cache.hpp"
+
+namespace vts
+{
+
+namespace
+{
+
+static const char Magic[] = "vtsfetch";
+static const uint16 Version = 1;
+
+typedef std::chrono::steady_clock Clock;
+
+// one reply stored in the archive
+struct Record
+{
+    std::string contentType;
+    std::string redirectUrl;
+    std::string etag;
+    std::string lastModified;
+    sint64 expires;
+    uint32 code;
+    uint32 latency; // miliseconds
+    uint32 resourceType;
+    uint64 bodyOffset; // into the archive file
+    uint32 bodySize;
+};
+
+template<class T>
+void writeValue(std::ostream &out, T v)
+{
+    out.write((const char *)&v, sizeof(T));
+}
+
+void writeString(std::ostream &out, const std::string &s)
+{
+    writeValue<uint32>(out, s.length());
+    out.write(s.data(), s.length());
+}
+
+// reads the records sequentially, the bodies are skipped
+class Reader
+{
+public:
+    Reader(std::istream &in, uint64 size) : in(in), size(size), pos(0)
+    {}
+
+    template<class T>
+    T value()
+    {
+        T v;
+        read((char *)&v, sizeof(T));
+        return v;
+    }
+
+    std::string string()
+    {
+        std::string s(value<uint32>(), 0);
+        read(&s[0], s.size());
+        return s;
+    }
+
+    void read(char *data, uint64 len)
+    {
+        check(len);
+        if (len > 0 && !in.read(data, len))
+            LOGTHROW(err2, std::runtime_error) << "Fetch archive is truncated";
+        pos += len;
+    }
+
+    void skip(uint64 len)
+    {
+        check(len);
+        pos += len;
+        if (!in.seekg(pos))
+            LOGTHROW(err2, std::runtime_error) << "Fetch archive is truncated";
+    }
+
+    bool eof() const
+    {
+        return pos == size;
+    }
+
+    std::istream &in;
+    const uint64 size;
+    uint64 pos;
+
+private:
+    void check(uint64 len) const
+    {
+        if (len > size - pos)
+            LOGTHROW(err2, std::runtime_error) << "Fetch archive is truncated";
+    }
+};
+
+////////////////////////////
+/// RECORDER
+////////////////////////////
+
+class ArchiveWriter
+{
+public:
+    ArchiveWriter(const std::string &path) : path(path)
+    {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            LOGTHROW(err3, std::runtime_error)
+                    << "Failed to open fetch archive <" << path << ">";
+        }
+        out.write(Magic, sizeof(Magic));
+        writeValue(out, Version);
+        LOG(info3) << "Recording downloads into <" << path << ">";
+    }
+
+    void write(const FetchTask &task, uint32 latency)
+    {
+        const FetchTask::Reply &r = task.reply;
+        boost::lock_guard<boost::mutex> l(mut);
+        writeString(out, task.query.url);
+        writeValue<uint32>(out, (uint32)task.query.resourceType);
+        writeValue<uint32>(out, r.code);
+        writeValue<sint64>(out, r.expires);
+        writeValue<uint32>(out, latency);
+        writeString(out, r.contentType);
+        writeString(out, r.redirectUrl);
+        writeString(out, r.etag);
+        writeString(out, r.lastModified);
+        writeValue<uint32>(out, r.content.size());
+        out.write(r.content.data(), r.content.size());
+    }
+
+    void flush()
+    {
+        boost::lock_guard<boost::mutex> l(mut);
+        out.flush();
+        if (!out)
+            LOG(err3) << "Failed to write fetch archive <" << path << ">";
+    }
+
+private:
+    const std::string path;
+    std::ofstream out;
+    boost::mutex mut;
+};
+
+class RecorderImpl;
+
+// intercepts the reply of the original task
+class RecordTask : public FetchTask
+{
+public:
+    RecordTask(RecorderImpl *impl, const std::shared_ptr<FetchTask> &orig);
+    void fetchDone() override;
+
+    RecorderImpl *const impl;
+    const std::shared_ptr<FetchTask> orig;
+    const Clock::time_point begin;
+};
+
+class RecorderImpl : public Fetcher
+{
+public:
+    RecorderImpl(const std::shared_ptr<Fetcher> &fetcher,
+                 const std::string &path) :
+        fetcher(fetcher), writer(path)
+    {}
+
+    void initialize() override
+    {
+        fetcher->initialize();
+    }
+
+    void finalize() override
+    {
+        fetcher->finalize();
+        writer.flush();
+    }
+
+    void fetch(const std::shared_ptr<FetchTask> &task) override
+    {
+        auto t = std::make_shared<RecordTask>(this, task);
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            tasks[task.get()] = t;
+        }
+        fetcher->fetch(t);
+    }
+
+    bool cancel(const std::shared_ptr<FetchTask> &task) override
+    {
+        std::shared_ptr<RecordTask> t;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = tasks.find(task.get());
+            if (it == tasks.end())
+                return false;
+            t = it->second.lock();
+        }
+        return t && fetcher->cancel(t);
+    }
+
+    void hostStatistics(std::vector<FetcherHostStatistics> &hosts) override
+    {
+        fetcher->hostStatistics(hosts);
+    }
+
+    void done(RecordTask *t)
+    {
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            tasks.erase(t->orig.get());
+        }
+        if (t->reply.code != FetchTask::ExtraCodes::Cancelled)
+        {
+            writer.write(*t, std::chrono::duration_cast<
+                    std::chrono::milliseconds>(Clock::now() - t->begin)
+                         .count());
+        }
+    }
+
+private:
+    std::shared_ptr<Fetcher> fetcher;
+    ArchiveWriter writer;
+    std::unordered_map<FetchTask*, std::weak_ptr<RecordTask>> tasks;
+    boost::mutex mut;
+};
+
+RecordTask::RecordTask(RecorderImpl *impl,
+                       const std::shared_ptr<FetchTask> &orig) :
+    FetchTask(orig->query), impl(impl), orig(orig), begin(Clock::now())
+{
+    // later priority changes of the original task are not followed
+    fetchPriority.store(orig->fetchPriority);
+}
+
+void RecordTask::fetchDone()
+{
+    impl->done(this);
+    orig->reply = std::move(reply);
+    orig->fetchDone();
+}
+
+////////////////////////////
+/// REPLAY
+////////////////////////////
+
+struct Scheduled
+{
+    std::shared_ptr<FetchTask> task;
+    const Record *record; // null if the url is not in the archive
+};
+
+class ReplayImpl : public Fetcher
+{
+public:
+    ReplayImpl(const std::string &path, double latencyScale) :
+        latencyScale(latencyScale), initCount(0), stop(false)
+    {
+        // only the records are read now,
+        //   the bodies are read (or mapped) from the file when replayed
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+        {
+            LOGTHROW(err3, std::runtime_error)
+                    << "Failed to open fetch archive <" << path << ">";
+        }
+        Reader r(in, in.tellg());
+        in.seekg(0);
+        char magic[sizeof(Magic)] = {};
+        if (r.size >= sizeof(Magic) + sizeof(Version))
+            r.read(magic, sizeof(magic));
+        if (memcmp(magic, Magic, sizeof(Magic)) != 0)
+        {
+            LOGTHROW(err3, std::runtime_error)
+                    << "File <" << path << "> is not a fetch archive";
+        }
+        if (r.value<uint16>() != Version)
+        {
+            LOGTHROW(err3, std::runtime_error)
+                    << "Fetch archive <" << path
+                    << "> has unsupported version";
+        }
+        uint32 count = 0;
+        while (!r.eof())
+        {
+            std::string url = r.string();
+            Record rec;
+            rec.resourceType = r.value<uint32>();
+            rec.code = r.value<uint32>();
+            rec.expires = r.value<sint64>();
+            rec.latency = r.value<uint32>();
+            rec.contentType = r.string();
+            rec.redirectUrl = r.string();
+            rec.etag = r.string();
+            rec.lastModified = r.string();
+            rec.bodySize = r.value<uint32>();
+            rec.bodyOffset = r.pos;
+            r.skip(rec.bodySize);
+            records[url].list.push_back(std::move(rec));
+            count++;
+        }
+        file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            LOGTHROW(err3, std::runtime_error)
+                    << "Failed to open fetch archive <" << path << ">";
+        }
+        LOG(info3) << "Replaying " << count << " downloads from <"
+                   << path << ">";
+    }
+
+    ~ReplayImpl()
+    {
+        assert(initCount == 0);
+        fclose(file);
+    }
+
+    void initialize() override
+    {
+        if (initCount++ == 0)
+        {
+            stop = false;
+            thr = boost::thread(&ReplayImpl::entry, this);
+        }
+    }
+
+    void finalize() override
+    {
+        if (--initCount == 0)
+        {
+            {
+                boost::lock_guard<boost::mutex> l(mut);
+                stop = true;
+                cond.notify_all();
+            }
+            thr.join();
+            std::multimap<Clock::time_point, Scheduled> left;
+            {
+                boost::lock_guard<boost::mutex> l(mut);
+                left.swap(scheduled);
+            }
+            for (auto &it : left)
+            {
+                it.second.task->reply.code = FetchTask::ExtraCodes::Cancelled;
+                it.second.task->fetchDone();
+            }
+        }
+    }
+
+    void fetch(const std::shared_ptr<FetchTask> &task) override
+    {
+        assert(initCount > 0);
+        assert(task->reply.code == 0);
+        boost::lock_guard<boost::mutex> l(mut);
+        Scheduled s;
+        s.task = task;
+        s.record = nullptr;
+        uint32 latency = 0;
+        auto it = records.find(task->query.url);
+        if (it != records.end())
+        {
+            // repeated requests get the replies in the recorded order,
+            //   the last one is repeated once they run out
+            Entry &e = it->second;
+            s.record = &e.list[std::min<uint32>(e.next++,
+                                                e.list.size() - 1)];
+            latency = s.record->latency;
+        }
+        Clock::time_point due = Clock::now()
+                + std::chrono::microseconds(
+                    (sint64)(latency * latencyScale * 1000));
+        scheduled.emplace(due, std::move(s));
+        cond.notify_all();
+    }
+
+    bool cancel(const std::shared_ptr<FetchTask> &task) override
+    {
+        std::shared_ptr<FetchTask> t;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            for (auto it = scheduled.begin(); it != scheduled.end(); it++)
+            {
+                if (it->second.task == task)
+                {
+                    t = std::move(it->second.task);
+                    scheduled.erase(it);
+                    break;
+                }
+            }
+        }
+        if (!t)
+            return false;
+        t->reply.code = FetchTask::ExtraCodes::Cancelled;
+        t->fetchDone();
+        return true;
+    }
+
+private:
+    void entry()
+    {
+        setLogThreadName("fetch replay");
+        boost::unique_lock<boost::mutex> l(mut);
+        while (!stop)
+        {
+            if (scheduled.empty())
+            {
+                cond.wait(l);
+                continue;
+            }
+            auto it = scheduled.begin();
+            Clock::time_point now = Clock::now();
+            if (it->first > now)
+            {
+                cond.wait_for(l, boost::chrono::microseconds(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        it->first - now).count()));
+                continue;
+            }
+            Scheduled s = std::move(it->second);
+            scheduled.erase(it);
+            l.unlock();
+            reply(s);
+            l.lock();
+        }
+    }
+
+    void reply(const Scheduled &s)
+    {
+        FetchTask::Reply &r = s.task->reply;
+        if (s.record)
+        {
+            const Record &rec = *s.record;
+            r.contentType = rec.contentType;
+            r.redirectUrl = rec.redirectUrl;
+            r.etag = rec.etag;
+            r.lastModified = rec.lastModified;
+            r.expires = rec.expires;
+            r.code = rec.code;
+            try
+            {
+                r.content = cacheReadFile(file, rec.bodyOffset,
+                                          rec.bodySize);
+            }
+            catch (const std::exception &)
+            {
+                r.code = FetchTask::ExtraCodes::InternalError;
+            }
+        }
+        else
+        {
+            LOG(warn2) << "Download of <" << s.task->query.url
+                       << "> is not in the fetch archive";
+            r.code = 404;
+        }
+        s.task->fetchDone();
+    }
+
+    struct Entry
+    {
+        std::vector<Record> list;
+        uint32 next;
+        Entry() : next(0) {}
+    };
+
+    FILE *file;
+    std::unordered_map<std::string, Entry> records;
+    std::multimap<Clock::time_point, Scheduled> scheduled;
+    const double latencyScale;
+    std::atomic<int> initCount;
+    boost::thread thr;
+    boost::mutex mut;
+    boost::condition_variable cond;
+    bool stop;
+};
+
+} // namespace
+
+std::shared_ptr<Fetcher> Fetcher::createRecorder(
+        const std::shared_ptr<Fetcher> &fetcher, const std::string &path)
+{
+    return std::make_shared<RecorderImpl>(fetcher, path);
+}
+
+std::shared_ptr<Fetcher> Fetcher::createReplay(const std::string &path,
+                                               double latencyScale)
+{
+    return std::make_shared<ReplayImpl>(path, latencyScale);
+}
+
+} // namespace vts
@@ -25,6 +25,11 @@
  */
 
 #include <fstream>
+#include <mutex>
+#include <ctime>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
 #include <http/http.hpp>
 #include <http/resourcefetcher.hpp>
 #include "../include/vts-browser/fetcher.hpp"
@@ -36,6 +41,89 @@ namespace
 {
 
 class FetcherImpl;
+class Task;
+
+// concurrency of a newly seen host in the adaptive mode
+static const double InitialHostConcurrency = 4;
+
+// smoothing factor for the latency average
+static const double LatencySmoothing = 0.2;
+
+// latency this many times over the lowest observed one
+//   is considered a sign of overloaded host
+static const double LatencyOverload = 4;
+
+// latencies below this are never considered an overload
+static const double LatencyOverloadMinimum = 200;
+
+// the pending queue is rebuilt with the current priorities
+//   at most this often, in miliseconds
+static const uint64 PendingRebuildInterval = 100;
+
+// extracts the scheme, host and port from the url
+std::string hostFromUrl(const std::string &url)
+{
+    auto s = url.find("://");
+    if (s == std::string::npos)
+        return "";
+    return url.substr(0, url.find('/', s + 3));
+}
+
+// http status codes that indicate an overloaded host
+bool isOverloadCode(uint32 code)
+{
+    return code == 429 || (code >= 500 && code < 600)
+        || code == FetchTask::ExtraCodes::Timeout;
+}
+
+// transfer statistics and the adaptive concurrency control of a single host
+struct Host
+{
+    double limit;
+    double latency; // smoothed, in miliseconds
+    double minLatency;
+    uint64 lastDecrease; // time of the last multiplicative decrease
+    uint64 windowBegin; // for throughput measurement
+    uint64 windowBytes;
+    uint32 throughput; // KB per second
+    uint32 active;
+    uint32 succeeded;
+    uint32 failed;
+
+    Host() : limit(InitialHostConcurrency), latency(0), minLatency(-1),
+        lastDecrease(0), windowBegin(0), windowBytes(0), throughput(0),
+        active(0), succeeded(0), failed(0)
+    {}
+};
+
+// formats the time as in the Last-Modified header
+std::string httpDate(std::time_t t)
+{
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+// value of the ETag header
+//   older versions of the http library do not provide it,
+//   the conditional requests then use the Last-Modified only
+template<class Body>
+auto bodyEtag(const Body &body, int) -> decltype(std::string(body.etag))
+{
+    return body.etag;
+}
+
+template<class Body>
+std::string bodyEtag(const Body &, long)
+{
+    return "";
+}
 
 class Task
 {
@@ -43,21 +131,52 @@ public:
     Task(FetcherImpl *impl, const std::shared_ptr<FetchTask> &task);
     ~Task();
     void done(http::ResourceFetcher::MultiQuery &&queries);
+    void cancel();
+    bool claim();
     void finish();
 
     const uint64 begin;
     FetcherImpl *const impl;
     const uint32 id;
+    const std::string host;
+    Host *hostState;
     http::ResourceFetcher::Query query;
     std::shared_ptr<FetchTask> task;
-    bool called;
+    std::atomic<bool> called;
+    bool dispatched; // taken out of the pending queue, guarded by mutHosts
+    uint64 started; // when the transfer was handed to the http library
+};
+
+// a task waiting for a transfer slot
+//   the priority is a copy, the live one may change at any time
+struct Pending
+{
+    std::shared_ptr<Task> task;
+    float priority;
+    uint32 id;
 };
 
+// orders the heap so that the highest priority is at the top,
+//   ties are broken by the order of the requests
+bool operator < (const Pending &a, const Pending &b)
+{
+    if (a.priority != b.priority)
+        return a.priority < b.priority;
+    return a.id > b.id;
+}
+
 class FetcherImpl : public Fetcher
 {
 public:
     FetcherImpl(const FetcherOptions &options) : options(options),
-        fetcher(htt.fetcher()), initCount(0), taskId(0)
+        fetcher(htt.fetcher()), initCount(0), taskId(0),
+        maxHostConcurrency(options.maxHostConnections > 0
+            ? options.maxHostConnections
+            : std::max(options.maxTotalConnections, 1u)),
+        maxActive(options.maxActiveTransfers > 0
+            ? options.maxActiveTransfers
+            : std::numeric_limits<uint32>::max()),
+        lastRebuild(0), active(0)
     {
         begin = std::chrono::high_resolution_clock::now();
         if (options.extraFileLog)
@@ -93,6 +212,13 @@ public:
         if (--initCount == 0)
         {
             htt.stop();
+            std::vector<Pending> queued;
+            {
+                std::lock_guard<std::mutex> l(mutHosts);
+                queued.swap(pending);
+            }
+            for (auto &t : queued)
+                t.task->cancel();
         }
     }
 
@@ -101,13 +227,206 @@ public:
         assert(initCount > 0);
         assert(task->reply.code == 0);
         auto t = std::make_shared<Task>(this, task);
-        fetcher.perform(t->query, std::bind(&Task::done, t,
-                                            std::placeholders::_1));
+        {
+            std::lock_guard<std::mutex> l(mutTasks);
+            tasks[task.get()] = t;
+        }
         if (extraLog)
         {
             extraLog << t->begin << " init " << t->id
                      << " " << task->query.url << std::endl;
         }
+        std::vector<std::shared_ptr<Task>> starting;
+        {
+            std::lock_guard<std::mutex> l(mutHosts);
+            t->hostState = &hosts[t->host];
+            pending.push_back({ t, t->task->fetchPriority, t->id });
+            std::push_heap(pending.begin(), pending.end());
+            dispatch(starting);
+        }
+        for (auto &it : starting)
+            perform(it);
+    }
+
+    // moves the most important pending tasks to the http client
+    //   while there are free transfer slots
+    // must be called with mutHosts locked
+    void dispatch(std::vector<std::shared_ptr<Task>> &starting)
+    {
+        if (active >= maxActive || pending.empty())
+            return;
+
+        // the priorities may change at any time,
+        //   the heap is rebuilt with the current values periodically
+        //   and the top entries are checked when they are taken out
+        uint64 now = time();
+        if (now >= lastRebuild + PendingRebuildInterval)
+        {
+            lastRebuild = now;
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                [](const Pending &p) { return (bool)p.task->called; }),
+                pending.end());
+            for (Pending &p : pending)
+                p.priority = p.task->task->fetchPriority;
+            std::make_heap(pending.begin(), pending.end());
+        }
+
+        // tasks of hosts that are at their limit wait in here
+        std::vector<Pending> blocked;
+        std::size_t reinserts = pending.size();
+        while (active < maxActive && !pending.empty())
+        {
+            std::pop_heap(pending.begin(), pending.end());
+            Pending p = std::move(pending.back());
+            pending.pop_back();
+            if (p.task->called)
+                continue; // cancelled while pending
+            float priority = p.task->task->fetchPriority;
+            if (priority != p.priority && reinserts > 0)
+            {
+                reinserts--;
+                // reinsert with the current priority
+                p.priority = priority;
+                pending.push_back(std::move(p));
+                std::push_heap(pending.begin(), pending.end());
+                continue;
+            }
+            Task *t = p.task.get();
+            if (options.adaptiveConcurrency
+                    && t->hostState->active >= (uint32)t->hostState->limit)
+            {
+                blocked.push_back(std::move(p));
+                continue;
+            }
+            t->dispatched = true;
+            t->hostState->active++;
+            active++;
+            starting.push_back(std::move(p.task));
+        }
+        for (Pending &p : blocked)
+        {
+            pending.push_back(std::move(p));
+            std::push_heap(pending.begin(), pending.end());
+        }
+    }
+
+    void perform(const std::shared_ptr<Task> &t)
+    {
+        t->started = time();
+        fetcher.perform(t->query, std::bind(&Task::done, t,
+                                            std::placeholders::_1));
+    }
+
+    // updates the statistics and the concurrency limit of the host
+    //   and starts the pending tasks
+    void transferDone(Task *t, bool overload, uint64 bytes)
+    {
+        std::vector<std::shared_ptr<Task>> starting;
+        {
+            uint64 now = time();
+            double latency = (double)(now - t->started);
+            std::lock_guard<std::mutex> l(mutHosts);
+            Host &h = *t->hostState;
+            assert(h.active > 0 && active > 0);
+            h.active--;
+            active--;
+            if (h.minLatency < 0 || latency < h.minLatency)
+                h.minLatency = latency;
+            h.latency = h.latency == 0 ? latency
+                : h.latency + (latency - h.latency) * LatencySmoothing;
+            h.windowBytes += bytes;
+            if (now >= h.windowBegin + 1000)
+            {
+                h.throughput = h.windowBytes / (now - h.windowBegin);
+                h.windowBegin = now;
+                h.windowBytes = 0;
+            }
+            if (overload)
+                h.failed++;
+            else
+                h.succeeded++;
+            if (!overload && h.latency > LatencyOverloadMinimum
+                    && h.latency > h.minLatency * LatencyOverload)
+                overload = true;
+            if (overload)
+            {
+                // decrease at most once per round trip
+                if (now >= h.lastDecrease + (uint64)h.latency)
+                {
+                    h.limit = std::max(h.limit * 0.5, 1.0);
+                    h.lastDecrease = now;
+                }
+            }
+            else
+            {
+                // adds one per round trip with all slots busy
+                h.limit = std::min(h.limit + 1 / h.limit,
+                                   (double)maxHostConcurrency);
+            }
+            dispatch(starting);
+        }
+        for (auto &it : starting)
+            perform(it);
+    }
+
+    void hostStatistics(std::vector<FetcherHostStatistics> &stats) override
+    {
+        stats.clear();
+        std::lock_guard<std::mutex> l(mutHosts);
+        stats.reserve(hosts.size());
+        for (auto &it : hosts)
+        {
+            const Host &h = it.second;
+            FetcherHostStatistics s;
+            s.host = it.first;
+            s.concurrencyLimit = options.adaptiveConcurrency
+                    ? (uint32)h.limit : options.maxHostConnections;
+            s.active = h.active;
+            s.latencyMilliseconds = (uint32)h.latency;
+            s.throughputKBps = h.throughput;
+            s.succeeded = h.succeeded;
+            s.failed = h.failed;
+            stats.push_back(std::move(s));
+        }
+        for (auto &p : pending)
+        {
+            if (p.task->called)
+                continue;
+            for (auto &s : stats)
+                if (s.host == p.task->host)
+                    s.queued++;
+        }
+    }
+
+    bool cancel(const std::shared_ptr<FetchTask> &task) override
+    {
+        std::shared_ptr<Task> t;
+        {
+            std::lock_guard<std::mutex> l(mutTasks);
+            auto it = tasks.find(task.get());
+            if (it == tasks.end())
+                return false;
+            t = it->second.lock();
+        }
+        if (!t)
+            return false;
+        {
+            // the http client has no way to abort a transfer,
+            //   only the tasks still waiting in the queue are cancelled,
+            //   they are dropped from it when reached
+            std::lock_guard<std::mutex> l(mutHosts);
+            if (t->dispatched || !t->claim())
+                return false;
+        }
+        t->task->reply.code = FetchTask::ExtraCodes::Cancelled;
+        t->finish();
+        return true;
+    }
+
+    void removeTask(FetchTask *task)
+    {
+        std::lock_guard<std::mutex> l(mutTasks);
+        tasks.erase(task);
     }
 
     uint64 time()
@@ -124,11 +443,21 @@ public:
     std::atomic<uint32> taskId;
     std::ofstream extraLog;
     std::chrono::high_resolution_clock::time_point begin;
+    std::unordered_map<FetchTask*, std::weak_ptr<Task>> tasks;
+    std::mutex mutTasks;
+    std::unordered_map<std::string, Host> hosts; // references are stable
+    std::vector<Pending> pending; // binary heap
+    std::mutex mutHosts;
+    const uint32 maxHostConcurrency;
+    const uint32 maxActive;
+    uint64 lastRebuild;
+    uint32 active;
 };
 
 Task::Task(FetcherImpl *impl, const std::shared_ptr<FetchTask> &task)
     : begin(impl->time()), impl(impl), id(impl->taskId++),
-      query(task->query.url), task(task), called(false)
+      host(hostFromUrl(task->query.url)), hostState(nullptr),
+      query(task->query.url), task(task), called(false), dispatched(false), started(0)
 {
     query.timeout(impl->options.timeout);
     for (auto it : task->query.headers)
@@ -139,7 +468,7 @@ Task::~Task()
 {
     try // destructor must not throw
     {
-        if (!called)
+        if (claim())
             finish();
     }
     catch(...)
@@ -151,22 +480,41 @@ Task::~Task()
 void Task::done(utility::ResourceFetcher::MultiQuery &&queries)
 {
     assert(queries.size() == 1);
-    assert(task->reply.code == 0);
     http::ResourceFetcher::Query &q = *queries.begin();
+    {
+        // the transfer is accounted for even if the task was cancelled
+        bool overload = true;
+        uint64 bytes = 0;
+        if (q.valid())
+        {
+            overload = false;
+            bytes = q.get().data.size();
+        }
+        else if (q.ec())
+            overload = isOverloadCode(q.ec().value());
+        impl->transferDone(this, overload, bytes);
+    }
+    if (!claim())
+        return; // the task was cancelled
+    assert(task->reply.code == 0);
     if (q.valid())
     {
-        const http::ResourceFetcher::Query::Body &body = q.get();
+        // the queries are owned by this function,
+        //   the body may be moved out of it
+        http::ResourceFetcher::Query::Body &body
+            = const_cast<http::ResourceFetcher::Query::Body&>(q.get());
         if (body.redirect)
         {
             task->reply.code = body.redirect.value();
         }
         else
         {
-            task->reply.content.allocate(body.data.size());
-            memcpy(task->reply.content.data(), body.data.data(),
-                   body.data.size());
+            task->reply.content = Buffer(std::move(body.data));
             task->reply.contentType = body.contentType;
             task->reply.expires = body.expires;
+            task->reply.etag = bodyEtag(body, 0);
+            if (body.lastModified > 0)
+                task->reply.lastModified = httpDate(body.lastModified);
             task->reply.code = 200;
 
             // testing start
@@ -212,10 +560,24 @@ void Task::done(utility::ResourceFetcher::MultiQuery &&queries)
     finish();
 }
 
+void Task::cancel()
+{
+    // used for tasks that were not handed to the http client
+    if (!claim())
+        return;
+    task->reply.code = FetchTask::ExtraCodes::Cancelled;
+    finish();
+}
+
+bool Task::claim()
+{
+    return !called.exchange(true);
+}
+
 void Task::finish()
 {
-    assert(!called);
-    called = true;
+    assert(called);
+    impl->removeTask(task.get());
     if (impl->extraLog)
     {
         impl->extraLog << 
@@ -230,8 +592,13 @@ void Task::finish()
 
 std::shared_ptr<Fetcher> Fetcher::create(const FetcherOptions &options)
 {
-    return std::dynamic_pointer_cast<Fetcher>(
+    if (!options.replayPath.empty())
+        return createReplay(options.replayPath, options.replayLatencyScale);
+    std::shared_ptr<Fetcher> f = std::dynamic_pointer_cast<Fetcher>(
                 std::make_shared<FetcherImpl>(options));
+    if (!options.recordPath.empty())
+        return createRecorder(f, options.recordPath);
+    return f;
 }
 
 } // namespace vts
@@ -51,6 +51,12 @@ public:
         task->reply.contentType = [response.MIMEType UTF8String];
         task->reply.code = response.statusCode;
         task->reply.expires = -2;
+        NSString *etag = [response.allHeaderFields objectForKey:@"ETag"];
+        if (etag)
+            task->reply.etag = [etag UTF8String];
+        NSString *lastModified = [response.allHeaderFields objectForKey:@"Last-Modified"];
+        if (lastModified)
+            task->reply.lastModified = [lastModified UTF8String];
         task->reply.content.allocate([data length]);
         memcpy(task->reply.content.data(), [data bytes], [data length]);
     }
@@ -60,7 +66,13 @@ public:
     	std::shared_ptr<FetchTask> task = task_;
     	NSString *urlString = [NSString stringWithCString:task->query.url.c_str() encoding:NSUTF8StringEncoding];
 	    NSURL *url = [NSURL URLWithString:urlString];
-        [[session dataTaskWithURL:url completionHandler:^(NSData *data, NSURLResponse *response, NSError *error)
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+        for (auto &it : task->query.headers)
+        {
+            [request setValue:[NSString stringWithUTF8String:it.second.c_str()]
+                forHTTPHeaderField:[NSString stringWithUTF8String:it.first.c_str()]];
+        }
+        [[session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error)
         {
             if (error)
             {
@@ -93,8 +105,13 @@ public:
 
 std::shared_ptr<Fetcher> Fetcher::create(const FetcherOptions &options)
 {
-    return std::dynamic_pointer_cast<Fetcher>(
+    if (!options.replayPath.empty())
+        return createReplay(options.replayPath, options.replayLatencyScale);
+    std::shared_ptr<Fetcher> f = std::dynamic_pointer_cast<Fetcher>(
                 std::make_shared<FetcherImpl>(options));
+    if (!options.recordPath.empty())
+        return createRecorder(f, options.recordPath);
+    return f;
 }
 
 } // namespace vts
@@ -29,6 +29,8 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <memory>
 
 #include "foundation.hpp"
 
@@ -41,6 +43,19 @@ public:
     Buffer();
     explicit Buffer(uint32 size); // create preallocated buffer (it is not zeroed)
     explicit Buffer(const std::string &str); // create buffer from string
+
+    // create buffer that references externally managed memory
+    //   (eg. a memory mapped file)
+    //   the owner is released when the buffer is freed
+    //   empty owner makes a non-owning view,
+    //   the memory must then outlive the buffer
+    Buffer(char *data, uint32 size, std::shared_ptr<void> owner);
+
+    // create buffer that takes over the storage of the container
+    //   no data are copied
+    explicit Buffer(std::string &&str);
+    explicit Buffer(std::vector<char> &&vec);
+
     ~Buffer();
 
     // move semantics
@@ -54,6 +69,12 @@ public:
     // explicitly create a copy
     Buffer copy() const;
 
+    // create a buffer that references the same memory
+    //   if the memory is managed by an owner,
+    //   otherwise create a copy
+    // the memory must not be modified while it is shared
+    Buffer share() const;
+
     // explicitly create string out of the buffer
     std::string str() const;
 
@@ -73,9 +94,14 @@ public:
     char *data() const { return data_; }
     uint32 size() const { return size_; }
 
+    // false if the memory is managed externally
+    bool owned() const { return !external_; }
+
 private:
     char *data_;
     uint32 size_;
+    std::shared_ptr<void> owner_;
+    bool external_;
 };
 
 VTS_API void writeLocalFileBuffer(const std::string &path,
@@ -29,6 +29,8 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
+#include <vector>
 #include <map>
 
 #include "foundation.hpp"
@@ -57,6 +59,8 @@ public:
         SriIndex,
         GeodataFeatures,
         GeodataStylesheet,
+        // decoded form of another resource, stored in the disk cache only
+        Decoded,
     };
 
     static bool isResourceTypeMandatory(ResourceType resourceType);
@@ -69,6 +73,8 @@ public:
             Timeout = 10504,
             // Internal fetcher error.
             InternalError = 10500,
+            // The download was cancelled by the client.
+            Cancelled = 10499,
             // Content is not to be shown to the end user.
             ProhibitedContent = 10403,
             // Content is rejected to simulate errors for testing purposes.
@@ -91,6 +97,15 @@ public:
         std::string contentType;
         std::string redirectUrl;
 
+        // validators for conditional requests
+        //   (values of the ETag and Last-Modified headers)
+        // empty if not provided by the server
+        // requests for expired cached resources are sent with
+        //   If-None-Match and If-Modified-Since headers,
+        //   code 304 is then expected if the content has not changed
+        std::string etag;
+        std::string lastModified;
+
         // absolute time in seconds, comparable to std::time
         //   -1 = invalid value
         //   -2 = always revalidate
@@ -105,6 +120,10 @@ public:
     Query query;
     Reply reply;
 
+    // higher priority tasks are downloaded first
+    // may be changed while the task is waiting in the fetcher
+    std::atomic<float> fetchPriority;
+
     FetchTask(const Query &query);
     FetchTask(const std::string &url, ResourceType resourceType);
     virtual ~FetchTask();
@@ -138,17 +157,79 @@ public:
     // 2 = use http/2, fallback http/1
     // 3 = use http/2, fallback http/1.1
     sint32 pipelining;
+
+    // adjust the number of concurrent downloads for each host
+    //   based on the measured latency and errors
+    //   (additive increase, multiplicative decrease)
+    // maxHostConnections is used as the upper limit
+    bool adaptiveConcurrency;
+
+    // limit of transfers handed to curl at once
+    //   the other tasks wait in the fetcher
+    //   and are started in order of their priority
+    // 0 = unlimited
+    uint32 maxActiveTransfers;
+
+    // write all replies into an archive file
+    std::string recordPath;
+
+    // serve all replies from a previously recorded archive
+    //   instead of downloading them
+    std::string replayPath;
+
+    // multiplies the recorded latencies during replay
+    //   0 = replies are served immediately
+    double replayLatencyScale;
+};
+
+class VTS_API FetcherHostStatistics
+{
+public:
+    FetcherHostStatistics();
+
+    std::string host;
+    uint32 concurrencyLimit;
+    uint32 active;
+    uint32 queued; // waiting for the concurrency limit
+    uint32 latencyMilliseconds; // smoothed
+    uint32 throughputKBps;
+    uint32 succeeded;
+    uint32 failed;
 };
 
 class VTS_API Fetcher
 {
 public:
+    // the recordPath and replayPath options
+    //   select the fetchers below
     static std::shared_ptr<Fetcher> create(const FetcherOptions &options);
 
+    // wraps the fetcher and records all its replies into the archive
+    static std::shared_ptr<Fetcher> createRecorder(
+            const std::shared_ptr<Fetcher> &fetcher, const std::string &path);
+
+    // serves the replies recorded in the archive
+    //   with the recorded latencies multiplied by the scale
+    // urls missing in the archive fail with code 404
+    static std::shared_ptr<Fetcher> createReplay(const std::string &path,
+                                                 double latencyScale);
+
     virtual ~Fetcher();
     virtual void initialize() = 0;
     virtual void finalize() = 0;
     virtual void fetch(const std::shared_ptr<FetchTask> &) = 0;
+
+    // request to abandon the download of the task
+    // returns true if the download was abandoned,
+    //   the fetchDone is then called with the Cancelled code
+    // returns false if the download continues
+    //   (eg. it has already finished or cannot be interrupted)
+    // the default implementation returns false
+    virtual bool cancel(const std::shared_ptr<FetchTask> &);
+
+    // fills in state of all hosts contacted so far
+    // the default implementation returns no hosts
+    virtual void hostStatistics(std::vector<FetcherHostStatistics> &hosts);
 };
 
 } // namespace vts
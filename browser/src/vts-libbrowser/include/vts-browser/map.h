@@ -55,6 +55,7 @@ VTS_API double vtsMapGetRenderProgress(vtsHMap map);
 // data processing (may be run on a dedicated thread)
 VTS_API void vtsMapDataInitialize(vtsHMap map, vtsHFetcher fetcher);
 VTS_API void vtsMapDataTick(vtsHMap map);
+VTS_API bool vtsMapDataWaitForWork(vtsHMap map, double timeout); // seconds
 VTS_API void vtsMapDataFinalize(vtsHMap map);
 
 // rendering
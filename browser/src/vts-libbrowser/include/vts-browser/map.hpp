@@ -74,6 +74,10 @@ public:
 
     void dataInitialize(const std::shared_ptr<class Fetcher> &fetcher);
     void dataTick();
+    // blocks until there is new work for the data tick
+    //   or the timeout (in seconds) expires
+    // returns whether any work is available
+    bool dataWaitForWork(double timeout);
     void dataFinalize();
 
     void renderInitialize();
@@ -159,6 +163,10 @@ public:
     std::shared_ptr<class SearchTask> search(const std::string &query,
                      const std::array<double, 3> &lst); // navigation srs
 
+    // starts downloading a region into the disk cache
+    //   the progress is updated in renderTickPrepare
+    void seed(const std::shared_ptr<class SeedTask> &task);
+
     void printDebugInfo();
 
 private:
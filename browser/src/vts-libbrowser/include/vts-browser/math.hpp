@@ -112,6 +112,9 @@ VTS_API vec3 angularDiff(const vec3 &a, const vec3 &b);
 VTS_API double aabbPointDist(const vec3 &point,
                              const vec3 &min, const vec3 &max);
 VTS_API bool aabbTest(const vec3 aabb[2], const vec4 planes[6]);
+// the oriented box is given by its center and half-size scaled axes
+VTS_API bool obbTest(const vec3 &center, const vec3 axes[3],
+                     const vec4 planes[6]);
 VTS_API void frustumPlanes(const mat4 &vp, vec4 planes[6]);
 
 VTS_API vec3f convertRgbToHsv(const vec3f &inColor);
@@ -62,6 +62,23 @@ public:
     std::string customSrs1;
     std::string customSrs2;
 
+    // number of threads dedicated to decoding resources (images, meshes, ...)
+    //   the gpu upload callbacks are still invoked from Map::dataTick()
+    // zero to decode all resources directly in the data thread
+    uint32 decodeThreads;
+
+    // memory limit of the queue of writes into the disk cache,
+    //   the writes are performed in a background thread
+    //   and the pack files are synced once per batch of writes
+    //   (the per-file cache is never synced)
+    // zero to write into the cache directly
+    uint32 cacheWriteQueueKB;
+
+    // maximum size of the disk cache,
+    //   least recently used entries are evicted in a background thread
+    // zero for unlimited size
+    uint32 cacheMaxSizeMB;
+
     // true to disable the hard drive cache entirely
     bool disableCache;
 
@@ -71,6 +88,27 @@ public:
     //          is clearly reflected in the cached file name
     bool hashCachePaths;
 
+    // true -> store all cached resources in a few append-only pack files
+    //         with an index kept in memory (the cache must not be shared
+    //         by multiple processes)
+    // false -> store each resource in a separate file
+    bool packCacheFiles;
+
+    // true to compress the entries in the disk cache
+    //   (except for images, which are compressed already)
+    bool cacheCompression;
+
+    // true to also store decoded meshes and textures in the disk cache
+    //   resources found there skip decoding entirely
+    //   (it takes considerably more disk space)
+    bool cacheDecodedResources;
+
+    // true -> when the cache write queue is full, new writes wait
+    //   a few milliseconds for space and are dropped afterwards
+    // false -> when the cache write queue is full, the writer waits
+    //   (the writes come from the fetcher threads, which are blocked)
+    bool cacheWriteQueueDropOnFull;
+
     // true to try detect Earth and only use the fallbacks on it
     bool disableSearchUrlFallbackOutsideEarth;
 
@@ -148,6 +186,12 @@ public:
     // maximum position change allowed for PIHA, must be positive
     double navigationPihaPositionChange;
 
+    // time budget for single dataTick, in milliseconds
+    // resources are processed in priority order until the budget is used up
+    //   (at least one resource is processed in every tick)
+    // zero to limit the dataTick by maxResourceProcessesPerTick instead
+    double maxDataTickMilliseconds;
+
     // relative scale of every tile.
     // small up-scale may reduce occasional holes on tile borders.
     double renderTilesScale;
@@ -159,6 +203,7 @@ public:
     uint32 maxConcurrentDownloads;
 
     // maximum number of resources processed per dataTick
+    // ignored when maxDataTickMilliseconds is set
     uint32 maxResourceProcessesPerTick;
 
     // number of virtual samples to fit the view-extent
@@ -177,6 +222,17 @@ public:
     // each subsequent retry is delayed twice as long as before
     uint32 fetchFirstRetryTimeOffset;
 
+    // number of render ticks after which downloads of resources
+    //   that are no longer accessed are cancelled
+    // zero to never cancel downloads
+    uint32 fetchCancelStaleTicks;
+
+    // maximum number of traverse nodes checked per render tick
+    //   when looking for nodes that are no longer accessed
+    // the whole tree is swept incrementally over multiple ticks
+    // zero to check the whole tree every tick
+    uint32 maxTraverseClearingPerTick;
+
     NavigationType navigationType;
     NavigationMode navigationMode;
     TraverseMode traverseModeSurfaces;
@@ -209,6 +265,11 @@ public:
     //   objective position converges to ground
     bool enableCameraAltitudeChanges;
 
+    // reuse the draws of the previous frame when neither the camera,
+    //   the window size, the render options nor any of the resources
+    //   have changed since
+    bool enableFrameReuse;
+
     bool debugDetachedCamera;
     bool debugEnableVirtualSurfaces;
     bool debugEnableSri;
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SEED_HPP_bfhwuaeirrg
+#define SEED_HPP_bfhwuaeirrg
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <atomic>
+
+#include "foundation.hpp"
+
+namespace vts
+{
+
+// downloads all tiles of a region into the disk cache
+//   for later use without (or with poor) network connection
+// resources already present in the cache are not downloaded again,
+//   therefore an interrupted seeding may be resumed by running it again
+class VTS_API SeedTask
+{
+public:
+    // extents: navigation srs, [llx, lly, urx, ury]
+    SeedTask(const double extents[4], uint32 lodMin, uint32 lodMax);
+    virtual ~SeedTask();
+
+    // parameters
+    //   may be changed before the task is passed to the map
+
+    double extents[4];
+    uint32 lodMin;
+    uint32 lodMax;
+    // optional bounding polygon, navigation srs
+    //   only tiles that overlap both the polygon and the extents are seeded
+    std::vector<std::array<double, 2>> polygon;
+    // only walk the metatiles and download a few samples of each resource
+    //   type to estimate the size of the whole region
+    bool estimateOnly;
+
+    // progress
+    //   updated by Map::renderTickPrepare
+
+    uint32 nodesVisited; // metanodes overlapping the region
+    uint32 resourcesTotal; // tile resources found so far
+    uint32 resourcesDone; // downloaded or already cached
+    uint32 resourcesCached; // found in the cache (eg. when resuming)
+    uint32 resourcesFailed;
+    uint64 bytesDone;
+    uint64 bytesEstimated; // extrapolated for all resources found so far
+    std::atomic<bool> done;
+
+    std::shared_ptr<class SeedTaskImpl> impl;
+};
+
+} // namespace vts
+
+#endif
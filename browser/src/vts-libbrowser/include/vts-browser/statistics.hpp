@@ -56,10 +56,20 @@ public:
 
     uint32 resourcesDownloaded;
     uint32 resourcesDiskLoaded;
+    uint32 resourcesDecodedLoaded; // skipped decoding
     uint32 resourcesProcessed;
     uint32 resourcesCreated;
     uint32 resourcesReleased;
     uint32 resourcesFailed;
+    uint32 resourcesCancelled;
+    uint32 resourcesRevalidated; // not modified since cached
+    uint32 nodesCleared; // stale traverse subtrees released
+    uint32 framesReused; // render ticks that skipped the traversal
+    uint32 cacheWritesDropped;
+    uint32 cacheEntriesEvicted;
+    uint32 cacheLookupHits;
+    uint32 cacheLookupMisses;
+    uint32 cacheLookupFalsePositives; // misses not caught by the index
     uint32 renderTicks;
     uint32 dataTicks;
 
@@ -70,8 +80,16 @@ public:
     uint32 resourcesActive;
     uint32 resourcesDownloading;
     uint32 resourcesPreparing;
+    uint32 resourcesDecoding;
+    uint32 resourcesFetchQueued; // waiting for a host connection slot
+    uint32 currentDataTickMicroseconds;
+    uint32 currentDataTickDeferred; // resources left for next dataTick
+    uint32 cacheWriteQueueDepth;
+    uint32 cacheWriteLatencyMicroseconds;
+    uint32 cacheDiskUseMB;
     uint32 currentNodeMetaUpdates;
     uint32 currentNodeDrawsUpdates;
+    uint32 currentNodesSwept; // checked for staleness
     NavigationMode currentNavigationMode;
 };
 
@@ -35,6 +35,8 @@
 #include <queue>
 #include <array>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/utility/in_place_factory.hpp>
 #include <vts-libs/vts/urltemplate.hpp>
 #include <vts-libs/vts/nodeinfo.hpp>
@@ -49,6 +51,7 @@
 #include "include/vts-browser/options.hpp"
 #include "include/vts-browser/callbacks.hpp"
 #include "include/vts-browser/search.hpp"
+#include "include/vts-browser/seed.hpp"
 #include "include/vts-browser/draws.hpp"
 #include "include/vts-browser/math.hpp"
 #include "include/vts-browser/exceptions.hpp"
@@ -58,6 +61,7 @@
 #include "resources/cache.hpp"
 #include "credits.hpp"
 #include "coordsManip.hpp"
+#include "coarseness.hpp"
 #include "utilities/array.hpp"
 
 #ifndef NDEBUG
@@ -83,6 +87,54 @@ enum class Validity
     Valid,
 };
 
+// compact identification of a resource generated from an url template
+// it avoids expanding and hashing the url on every lookup
+class ResourceKey
+{
+public:
+    enum class Slot : uint8
+    {
+        MetaTile,
+        Mesh,
+        InternalTexture,
+        ExternalTexture,
+        MaskTexture,
+        BoundMetaTile,
+    };
+
+    ResourceKey(uint32 source, Slot slot, const TileId &tileId,
+                uint32 subMesh = 0);
+    bool operator == (const ResourceKey &other) const;
+    bool operator < (const ResourceKey &other) const;
+    std::size_t hash() const;
+
+    TileId tileId;
+    uint32 source; // unique id of the owner of the url template
+    uint32 subMesh;
+    Slot slot;
+};
+
+uint32 newResourceKeySource();
+
+} // namespace vts
+
+namespace std
+{
+
+template<>
+struct hash<vts::ResourceKey>
+{
+    std::size_t operator () (const vts::ResourceKey &key) const
+    {
+        return key.hash();
+    }
+};
+
+} // namespace std
+
+namespace vts
+{
+
 class Resource : public FetchTask
 {
 public:
@@ -91,6 +143,8 @@ public:
         initializing,
         downloading,
         downloaded,
+        decoding,
+        decoded,
         ready,
         errorFatal,
         errorRetry,
@@ -102,10 +156,18 @@ public:
     Resource(const Resource &other) = delete;
     Resource &operator = (const Resource &other) = delete;
     virtual ~Resource();
-    virtual void load() = 0;
+    virtual void decode(); // cpu only, may run in a decode thread
+    virtual void load() = 0; // always runs in the data thread
     void fetchDone() override;
-    void processLoad(); // calls load
+    void prepareLoad();
+    void processDecode(); // calls decode
+    void processUpload(); // calls load
+    void processLoad(); // all of the above
+    void processFailed(const std::exception &e);
+    void accountMemory();
     bool performAvailTest() const;
+    bool allowDecodedCache() const;
+    void writeDecodedCache(const Buffer &buffer);
     void updatePriority(float priority);
     void reset();
     operator bool () const;
@@ -118,9 +180,35 @@ public:
     std::time_t retryTime;
     uint32 retryNumber;
     uint32 redirectionsCount;
-    uint32 lastAccessTick;
+    std::atomic<uint32> lastAccessTick; // written by the render thread
+    uint32 ramMemoryAccounted;
+    uint32 gpuMemoryAccounted;
+
+    // memory costs of the loaded content, which is kept while
+    //   an expired resource is revalidated with the server
+    uint32 revalidateRamMemoryCost;
+    uint32 revalidateGpuMemoryCost;
+    bool revalidateLoaded;
+
+    // the content was read from the cache of decoded resources
+    bool contentDecoded;
+
     float priority;
     float priorityCopy;
+
+    // position in the data queue heap and the handoff it was last
+    // requested in (owned by the data thread)
+    uint32 dataQueueIndex;
+    uint32 dataQueueGeneration;
+
+    // intrusive list of resources ordered by last access
+    //   or the list of parked resources (owned by the render thread)
+    Resource *lruPrev;
+    Resource *lruNext;
+    bool lruParked;
+
+    // keys referencing this resource (owned by the render thread)
+    std::vector<ResourceKey> keys;
 };
 
 std::ostream &operator << (std::ostream &stream, Resource::State state);
@@ -129,14 +217,22 @@ class GpuMesh : public Resource
 {
 public:
     GpuMesh(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
+
+private:
+    GpuMeshSpec decoded;
 };
 
 class GpuTexture : public Resource
 {
 public:
     GpuTexture(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
+
+private:
+    GpuTextureSpec decoded;
 };
 
 class AuthConfig : public Resource
@@ -174,6 +270,7 @@ class BoundMetaTile : public Resource
 {
 public:
     BoundMetaTile(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
 
     uint8 flags[vtslibs::registry::BoundLayer::rasterMetatileWidth
@@ -184,6 +281,7 @@ class MetaTile : public Resource, public vtslibs::vts::MetaTile
 {
 public:
     MetaTile(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
 };
 
@@ -203,15 +301,20 @@ class MeshAggregate : public Resource
 {
 public:
     MeshAggregate(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
 
     std::vector<MeshPart> submeshes;
+
+private:
+    std::vector<GpuMeshSpec> decoded;
 };
 
 class NavTile : public Resource
 {
 public:
     NavTile(MapImpl *map, const std::string &name);
+    void decode() override;
     void load() override;
 
     std::vector<unsigned char> data;
@@ -230,6 +333,19 @@ public:
     const std::string validitySrs;
 };
 
+// raw tile data downloaded into the disk cache only
+class SeedResource : public Resource
+{
+public:
+    SeedResource(MapImpl *map, const std::string &name,
+                 FetchTask::ResourceType resourceType);
+    void fetchDone() override;
+    void load() override;
+
+    uint32 size;
+    bool fetched; // false if it was loaded from the disk cache
+};
+
 class TilesetMapping : public Resource
 {
 public:
@@ -294,6 +410,7 @@ public:
     UrlTemplate urlExtTex;
     UrlTemplate urlMeta;
     UrlTemplate urlMask;
+    uint32 keySource;
 };
 
 class FreeInfo : public vtslibs::registry::FreeLayer
@@ -328,6 +445,7 @@ private:
     Validity prepareDepth(MapImpl *impl, double priority);
 
     UrlTemplate::Vars orig;
+    uint32 subMesh;
     sint32 depth;
 };
 
@@ -350,6 +468,7 @@ public:
     UrlTemplate urlGeodata;
     vtslibs::vts::TilesetIdList name;
     vec3f color;
+    uint32 keySource;
     bool alien;
 };
 
@@ -386,42 +505,83 @@ public:
     bool ready() const;
 };
 
+// data of traverse node that are not needed for culling
+class TraverseNodeCold
+{
+public:
+    // metadata
+    std::vector<std::shared_ptr<MetaTile>> metaTiles;
+    boost::optional<vtslibs::vts::MetaNode> meta;
+    boost::optional<vec3> surrogatePhys;
+    boost::optional<float> surrogateNav;
+
+    // renders
+    std::shared_ptr<Resource> touchResource;
+    std::vector<vtslibs::registry::CreditId> credits;
+    std::vector<RenderTask> opaque;
+    std::vector<RenderTask> transparent;
+    std::vector<RenderTask> geodata;
+};
+
+// allocates traverse nodes from large chunks of memory
+//   so that the traversal walks dense memory
+// blocks of each size have separate chunks
+// render thread only
+class TraverseNodePool
+{
+public:
+    TraverseNodePool();
+    ~TraverseNodePool();
+    void *allocate(std::size_t size);
+    void deallocate(void *ptr, std::size_t size);
+    TraverseNodeCold *createCold();
+    void destroyCold(TraverseNodeCold *cold);
+
+private:
+    struct Blocks
+    {
+        std::vector<std::unique_ptr<char[]>> chunks;
+        void *freeList;
+        std::size_t size;
+    };
+    std::vector<Blocks> blocks;
+    Blocks &find(std::size_t size);
+};
+
 class TraverseNode
 {
 public:
     struct Obb
     {
-        mat4 rotInv;
-        vec3 points[2];
+        // physical coordinates
+        vec3 center;
+        vec3 axes[3]; // scaled to half of the size
     };
 
     // traversal
     Array<std::shared_ptr<TraverseNode>, 4> childs;
     MapLayer *const layer;
     TraverseNode *const parent;
+    TraverseNodeCold *const cold;
     const NodeInfo nodeInfo;
     const uint32 hash;
 
-    // metadata
-    std::vector<std::shared_ptr<MetaTile>> metaTiles;
-    boost::optional<vtslibs::vts::MetaNode> meta;
+    // culling
+    vtslibs::vts::MetaNode *meta; // points into the cold data
     boost::optional<Obb> obb;
     vec3 cornersPhys[8];
     vec3 aabbPhys[2];
-    boost::optional<vec3> surrogatePhys;
-    boost::optional<float> surrogateNav;
+    double texelSize; // infinity if the coarseness test always fails
     const SurfaceInfo *surface;
 
     uint32 lastAccessTime;
     uint32 lastRenderTime;
+    uint32 visibleTime; // when the visible was determined by batch test
     float priority;
+    bool visible;
 
-    // renders
-    std::shared_ptr<Resource> touchResource;
-    std::vector<vtslibs::registry::CreditId> credits;
-    std::vector<RenderTask> opaque;
-    std::vector<RenderTask> transparent;
-    std::vector<RenderTask> geodata;
+    static std::shared_ptr<TraverseNode> create(MapLayer *layer,
+                TraverseNode *parent, const NodeInfo &nodeInfo);
 
     TraverseNode(MapLayer *layer, TraverseNode *parent,
                  const NodeInfo &nodeInfo);
@@ -457,8 +617,12 @@ public:
     SurfaceStack surfaceStack;
     boost::optional<SurfaceStack> tilesetStack;
 
+    std::shared_ptr<TraverseNodePool> traversePool;
     std::shared_ptr<TraverseNode> traverseRoot;
 
+    // nodes left to be checked by the incremental clearing
+    std::vector<TraverseNode*> clearingStack;
+
     MapImpl *const map;
     TraverseMode traverseMode;
     Credits::Scope creditScope;
@@ -548,16 +712,51 @@ public:
         std::shared_ptr<Cache> cache;
         std::shared_ptr<AuthConfig> auth;
         std::shared_ptr<Fetcher> fetcher;
+        std::vector<FetcherHostStatistics> fetcherHosts;
         std::unordered_map<std::string, std::shared_ptr<Resource>> resources;
+        std::unordered_map<ResourceKey, std::weak_ptr<Resource>>
+                                            resourcesByKey; // render thread
+        // downloads of seed tasks, kept apart from the resources
+        //   of the traversal, which expects its own types under the names
+        std::unordered_map<std::string, std::shared_ptr<SeedResource>>
+                                            seedResources; // render thread
         std::vector<std::shared_ptr<Resource>> resourcesCopy;
+        std::vector<std::shared_ptr<Resource>> dataQueue; // binary heap
+        std::vector<std::shared_ptr<Resource>> fetching; // data thread only
         std::deque<std::weak_ptr<SearchTask>> searchTasks;
+        std::deque<std::weak_ptr<SeedTask>> seedTasks;
         std::deque<std::shared_ptr<SriIndex>> sriTasks;
+        std::vector<boost::thread> decodeThreads;
+        std::deque<std::shared_ptr<Resource>> decodeQueue;
+        std::deque<std::shared_ptr<Resource>> decodedQueue;
+        Resource *lruFirst; // least recently used
+        Resource *lruLast; // most recently used
+        Resource *parkedFirst; // stale, but still used elsewhere
+        Resource *parkedLast;
         boost::mutex mutResourcesCopy;
+        boost::mutex mutDecode;
+        boost::mutex mutDataWork;
+        boost::condition_variable condDecode;
+        boost::condition_variable condDataWork;
         std::string authPath;
         std::string sriPath;
         std::atomic<uint32> downloads;
+        std::atomic<uint64> ramMemoryUse;
+        std::atomic<uint64> gpuMemoryUse;
+        // incremented whenever a resource changes state
+        //   in a way that may affect the rendered frame
+        std::atomic<uint32> stateEpoch;
+        // render tick index published for the data thread
+        std::atomic<uint32> renderTickIndex;
         uint32 tickIndex;
         uint32 progressEstimationMaxResources;
+        uint32 dataQueueGeneration;
+        // resources touched in this tick (render thread)
+        std::vector<Resource*> touched;
+        // resources touched in this tick that are not loaded yet
+        uint32 touchedUnsettled;
+        bool decodeStop;
+        bool dataWork;
 
         Resources();
     } resources;
@@ -574,9 +773,31 @@ public:
         vec3 forwardUnitVector;
         vec3 cameraPosPhys;
         vec3 focusPosPhys;
+        CoarsenessCamera coarseness;
         uint32 windowWidth;
         uint32 windowHeight;
         uint32 tickIndex;
+
+        // state of the last traversed frame
+        //   used to decide whether its draws can be reused
+        struct LastFrame
+        {
+            MapOptions options;
+            // resources touched while the frame was traversed
+            //   they stay valid while the state epoch is unchanged,
+            //   because releasing any resource increments it
+            std::vector<Resource*> touched;
+            mat4 viewProjRender;
+            mat4 viewRender;
+            uint32 windowWidth;
+            uint32 windowHeight;
+            uint32 stateEpoch;
+            uint32 infographics;
+            bool settled;
+
+            LastFrame();
+        } lastFrame;
+        bool frameReused;
         
         Renderer();
     } renderer;
@@ -613,23 +834,41 @@ public:
     void resourceDataInitialize(const std::shared_ptr<Fetcher> &fetcher);
     void resourceDataFinalize();
     bool resourceDataTick();
+    void resourceCancelStaleDownloads();
+    bool resourceDataWait(double timeout);
+    void resourceDataNotify();
+    void resourceDecodeInitialize();
+    void resourceDecodeFinalize();
+    void resourceDecodeEntry(uint32 index);
     void resourceRenderInitialize();
     void resourceRenderFinalize();
     void resourceRenderTick();
     void touchResource(const std::shared_ptr<Resource> &resource);
+    void touchResource(Resource *resource);
+    void touchResourcesRepeat();
     void resourceInitializeDownload(const std::shared_ptr<Resource> &resource);
+    void resourceInsert(const std::shared_ptr<Resource> &resource);
+    bool resourceRelease(Resource *resource);
     std::shared_ptr<GpuTexture> getTexture(const std::string &name);
+    std::shared_ptr<GpuTexture> getTexture(const ResourceKey &key,
+            const UrlTemplate &url, const UrlTemplate::Vars &vars);
     std::shared_ptr<GpuMesh> getMesh(const std::string &name);
     std::shared_ptr<AuthConfig> getAuthConfig(const std::string &name);
     std::shared_ptr<MapConfig> getMapConfig(const std::string &name);
     std::shared_ptr<MetaTile> getMetaTile(const std::string &name);
+    std::shared_ptr<MetaTile> getMetaTile(const ResourceKey &key,
+            const UrlTemplate &url, const UrlTemplate::Vars &vars);
     std::shared_ptr<NavTile> getNavTile(const std::string &name);
     std::shared_ptr<MeshAggregate> getMeshAggregate(const std::string &name);
+    std::shared_ptr<MeshAggregate> getMeshAggregate(const ResourceKey &key,
+            const UrlTemplate &url, const UrlTemplate::Vars &vars);
     std::shared_ptr<ExternalBoundLayer> getExternalBoundLayer(
             const std::string &name);
     std::shared_ptr<ExternalFreeLayer> getExternalFreeLayer(
             const std::string &name);
     std::shared_ptr<BoundMetaTile> getBoundMetaTile(const std::string &name);
+    std::shared_ptr<BoundMetaTile> getBoundMetaTile(const ResourceKey &key,
+            const UrlTemplate &url, const UrlTemplate::Vars &vars);
     std::shared_ptr<SearchTaskImpl> getSearchTask(const std::string &name);
     std::shared_ptr<TilesetMapping> getTilesetMapping(const std::string &name);
     std::shared_ptr<SriIndex> getSriIndex(const std::string &name);
@@ -642,6 +881,10 @@ public:
     std::shared_ptr<SearchTask> search(const std::string &query,
                                        const double point[3]);
     void updateSearch();
+    std::shared_ptr<Resource> getSeedResource(const std::string &name,
+            FetchTask::ResourceType resourceType);
+    void seed(const std::shared_ptr<SeedTask> &task);
+    void updateSeeds();
     void initiateSri(const vtslibs::registry::Position *position);
     void updateSris();
     double getMapRenderProgress();
@@ -658,8 +901,10 @@ public:
     void touchDraws(const std::vector<RenderTask> &renders);
     void touchDraws(TraverseNode *trav);
     bool visibilityTest(TraverseNode *trav);
+    void visibilityTestChilds(TraverseNode *trav);
     bool coarsenessTest(TraverseNode *trav);
     double coarsenessValue(TraverseNode *trav);
+    double coarsenessValueReference(TraverseNode *trav);
     void renderNode(TraverseNode *trav,
                     const vec4f &uvClip = vec4f(-1,-1,2,2));
     void renderNodePartialRecursive(TraverseNode *trav,
@@ -685,7 +930,8 @@ public:
     void travModeFlat(TraverseNode *trav);
     void travModeBalanced(TraverseNode *trav);
     void traverseRender(TraverseNode *trav);
-    void traverseClearing(TraverseNode *trav);
+    void traverseClearing(MapLayer *layer);
+    bool frameReusable();
     void updateCamera();
     bool prerequisitesCheck();
     uint32 applyCameraRotationNormalization(vec3 &rot);
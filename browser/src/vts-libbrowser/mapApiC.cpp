@@ -368,6 +368,14 @@ void vtsMapDataTick(vtsHMap map)
     C_END
 }
 
+bool vtsMapDataWaitForWork(vtsHMap map, double timeout)
+{
+    C_BEGIN
+    return map->p->dataWaitForWork(timeout);
+    C_END
+    return false;
+}
+
 void vtsMapDataFinalize(vtsHMap map)
 {
     C_BEGIN
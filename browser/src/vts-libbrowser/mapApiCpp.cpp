@@ -140,6 +140,11 @@ void Map::dataTick()
     impl->resourceDataTick();
 }
 
+bool Map::dataWaitForWork(double timeout)
+{
+    return impl->resourceDataWait(timeout);
+}
+
 void Map::dataFinalize()
 {
     impl->resourceDataFinalize();
@@ -848,6 +853,16 @@ std::shared_ptr<SearchTask> Map::search(const std::string &query,
     return search(query, point.data());
 }
 
+void Map::seed(const std::shared_ptr<SeedTask> &task)
+{
+    if (!getMapConfigReady())
+    {
+        LOGTHROW(err4, std::logic_error)
+                << "Map is not yet ready.";
+    }
+    impl->seed(task);
+}
+
 void Map::printDebugInfo()
 {
     impl->printDebugInfo();
@@ -34,7 +34,8 @@ FreeInfo::FreeInfo(const vtslibs::registry::FreeLayer &fl,
     : FreeLayer(fl), url(url)
 {}
 
-MapLayer::MapLayer(MapImpl *map) : map(map),
+MapLayer::MapLayer(MapImpl *map) :
+    traversePool(std::make_shared<TraverseNodePool>()), map(map),
     traverseMode(TraverseMode::Flat),
     creditScope(Credits::Scope::Imagery)
 {
@@ -43,7 +44,8 @@ MapLayer::MapLayer(MapImpl *map) : map(map),
 
 MapLayer::MapLayer(MapImpl *map, const std::string &name,
                    const vtslibs::registry::View::FreeLayerParams &params)
-    : freeLayerName(name), freeLayerParams(params), map(map),
+    : freeLayerName(name), freeLayerParams(params),
+      traversePool(std::make_shared<TraverseNodePool>()), map(map),
       traverseMode(TraverseMode::Flat),
       creditScope(Credits::Scope::Imagery)
 {
@@ -137,7 +139,7 @@ bool MapLayer::prerequisitesCheckMainSurfaces()
     if (surfaceStack.surfaces.empty())
         surfaceStack.generateReal(map);
 
-    traverseRoot = std::make_shared<TraverseNode>(this, nullptr, NodeInfo(
+    traverseRoot = TraverseNode::create(this, nullptr, NodeInfo(
                     mapConfig->referenceFrame, TileId(), false, *mapConfig));
     traverseRoot->priority = std::numeric_limits<double>::infinity();
 
@@ -155,7 +157,7 @@ bool MapLayer::prerequisitesCheckFreeLayer()
 
     surfaceStack.generateFree(map, *freeLayer);
 
-    traverseRoot = std::make_shared<TraverseNode>(this, nullptr, NodeInfo(
+    traverseRoot = TraverseNode::create(this, nullptr, NodeInfo(
                     mapConfig->referenceFrame, TileId(), false, *mapConfig));
     traverseRoot->priority = std::numeric_limits<double>::infinity();
 
@@ -174,7 +176,8 @@ bool MapImpl::generateMonolithicGeodataTrav(TraverseNode *trav)
             = boost::get<vtslibs::registry::FreeLayer::Geodata>(
                 trav->layer->freeLayer->definition);
 
-    trav->meta.emplace();
+    trav->cold->meta.emplace();
+    trav->meta = &*trav->cold->meta;
 
     // extents
     {
@@ -517,6 +517,20 @@ bool aabbTest(const vec3 aabb[2], const vec4 planes[6])
     return true;
 }
 
+bool obbTest(const vec3 &center, const vec3 axes[3], const vec4 planes[6])
+{
+    for (uint32 i = 0; i < 6; i++)
+    {
+        const vec4 &p = planes[i]; // current plane
+        vec3 n = vec4to3(p);
+        double r = std::abs(dot(n, axes[0])) + std::abs(dot(n, axes[1]))
+                + std::abs(dot(n, axes[2])); // projected radius
+        if (dot(n, center) + r < -p[3])
+            return false;
+    }
+    return true;
+}
+
 namespace
 {
 
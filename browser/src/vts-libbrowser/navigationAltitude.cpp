@@ -170,18 +170,18 @@ bool MapImpl::getPositionAltitude(double &result,
         auto t = findTravSds(travRoot, points[i], desiredLod);
         if (!t)
             return false;
-        if (!t->surrogateNav)
+        if (!t->cold->surrogateNav)
             return false;
         math::Extents2 ext = t->nodeInfo.extents();
         points[i] = vecFromUblas<vec2>(ext.ll + ext.ur) * 0.5;
-        altitudes[i] = *t->surrogateNav;
+        altitudes[i] = *t->cold->surrogateNav;
         minUsedLod = std::min(minUsedLod, (uint32)t->nodeInfo.nodeId().lod);
         if (options.debugRenderAltitudeShiftCorners)
         {
             RenderTask task;
             task.mesh = getMesh("internal://data/meshes/sphere.obj");
             task.mesh->priority = std::numeric_limits<float>::infinity();
-            task.model = translationMatrix(*t->surrogatePhys)
+            task.model = translationMatrix(*t->cold->surrogatePhys)
                     * scaleMatrix(t->nodeInfo.extents().size() * 0.031);
             task.color = vec4f(1.f, 1.f, 1.f, 1.f);
             if (*task.mesh)
@@ -39,8 +39,15 @@ MapCreateOptions::MapCreateOptions() :
     searchUrlFallback("https://eu-n1.windyty.com/search.php?format=json"
                        "&addressdetails=1&limit=20&q={value}"),
     searchSrsFallback("+proj=longlat +datum=WGS84 +nodefs"),
+    decodeThreads(0),
+    cacheWriteQueueKB(16384),
+    cacheMaxSizeMB(0),
     disableCache(false),
     hashCachePaths(true),
+    packCacheFiles(false),
+    cacheCompression(true),
+    cacheDecodedResources(false),
+    cacheWriteQueueDropOnFull(true),
     disableSearchUrlFallbackOutsideEarth(true),
     disableBrowserOptionsSearchUrls(false)
 {}
@@ -61,8 +68,15 @@ void MapCreateOptions::applyJson(const std::string &json)
     AJ(searchSrsFallback, asString);
     AJ(customSrs1, asString);
     AJ(customSrs2, asString);
+    AJ(decodeThreads, asUInt);
+    AJ(cacheWriteQueueKB, asUInt);
+    AJ(cacheMaxSizeMB, asUInt);
     AJ(disableCache, asBool);
     AJ(hashCachePaths, asBool);
+    AJ(packCacheFiles, asBool);
+    AJ(cacheCompression, asBool);
+    AJ(cacheDecodedResources, asBool);
+    AJ(cacheWriteQueueDropOnFull, asBool);
     AJ(disableSearchUrlFallbackOutsideEarth, asBool);
     AJ(disableBrowserOptionsSearchUrls, asBool);
 }
@@ -76,8 +90,15 @@ std::string MapCreateOptions::toJson() const
     TJ(searchSrsFallback, asString);
     TJ(customSrs1, asString);
     TJ(customSrs2, asString);
+    TJ(decodeThreads, asUInt);
+    TJ(cacheWriteQueueKB, asUInt);
+    TJ(cacheMaxSizeMB, asUInt);
     TJ(disableCache, asBool);
     TJ(hashCachePaths, asBool);
+    TJ(packCacheFiles, asBool);
+    TJ(cacheCompression, asBool);
+    TJ(cacheDecodedResources, asBool);
+    TJ(cacheWriteQueueDropOnFull, asBool);
     TJ(disableSearchUrlFallbackOutsideEarth, asBool);
     TJ(disableBrowserOptionsSearchUrls, asBool);
     return jsonToString(v);
@@ -135,6 +156,7 @@ MapOptions::MapOptions() :
     navigationLatitudeThreshold(80),
     navigationPihaViewExtentMult(1.02),
     navigationPihaPositionChange(0.02),
+    maxDataTickMilliseconds(0),
     renderTilesScale(1.001),
     targetResourcesMemoryKB(0),
     maxConcurrentDownloads(25),
@@ -143,6 +165,8 @@ MapOptions::MapOptions() :
     maxFetchRedirections(5),
     maxFetchRetries(5),
     fetchFirstRetryTimeOffset(1),
+    fetchCancelStaleTicks(60),
+    maxTraverseClearingPerTick(2000),
     navigationType(NavigationType::Quick),
     navigationMode(NavigationMode::Seamless),
     traverseModeSurfaces(TraverseMode::Balanced),
@@ -152,6 +176,7 @@ MapOptions::MapOptions() :
     enableArbitrarySriRequests(true),
     enableCameraNormalization(true),
     enableCameraAltitudeChanges(true),
+    enableFrameReuse(true),
     debugDetachedCamera(false),
     debugEnableVirtualSurfaces(true),
     debugEnableSri(false),
@@ -193,6 +218,7 @@ void MapOptions::applyJson(const std::string &json)
     AJ(navigationLatitudeThreshold, asDouble);
     AJ(navigationPihaViewExtentMult, asDouble);
     AJ(navigationPihaPositionChange, asDouble);
+    AJ(maxDataTickMilliseconds, asDouble);
     AJ(renderTilesScale, asDouble);
     AJ(targetResourcesMemoryKB, asUInt);
     AJ(maxConcurrentDownloads, asUInt);
@@ -201,6 +227,8 @@ void MapOptions::applyJson(const std::string &json)
     AJ(maxFetchRedirections, asUInt);
     AJ(maxFetchRetries, asUInt);
     AJ(fetchFirstRetryTimeOffset, asUInt);
+    AJ(fetchCancelStaleTicks, asUInt);
+    AJ(maxTraverseClearingPerTick, asUInt);
     AJE(navigationType, NavigationType);
     AJE(navigationMode, NavigationMode);
     AJE(traverseModeSurfaces, TraverseMode);
@@ -210,6 +238,7 @@ void MapOptions::applyJson(const std::string &json)
     AJ(enableArbitrarySriRequests, asBool);
     AJ(enableCameraNormalization, asBool);
     AJ(enableCameraAltitudeChanges, asBool);
+    AJ(enableFrameReuse, asBool);
     AJ(debugDetachedCamera, asBool);
     AJ(debugEnableVirtualSurfaces, asBool);
     AJ(debugEnableSri, asBool);
@@ -243,6 +272,7 @@ std::string MapOptions::toJson() const
     TJ(navigationLatitudeThreshold, asDouble);
     TJ(navigationPihaViewExtentMult, asDouble);
     TJ(navigationPihaPositionChange, asDouble);
+    TJ(maxDataTickMilliseconds, asDouble);
     TJ(renderTilesScale, asDouble);
     TJ(targetResourcesMemoryKB, asUInt);
     TJ(maxConcurrentDownloads, asUInt);
@@ -251,6 +281,8 @@ std::string MapOptions::toJson() const
     TJ(maxFetchRedirections, asUInt);
     TJ(maxFetchRetries, asUInt);
     TJ(fetchFirstRetryTimeOffset, asUInt);
+    TJ(fetchCancelStaleTicks, asUInt);
+    TJ(maxTraverseClearingPerTick, asUInt);
     TJE(navigationType, NavigationType);
     TJE(navigationMode, NavigationMode);
     TJE(traverseModeSurfaces, TraverseMode);
@@ -260,6 +292,7 @@ std::string MapOptions::toJson() const
     TJ(enableArbitrarySriRequests, asBool);
     TJ(enableCameraNormalization, asBool);
     TJ(enableCameraAltitudeChanges, asBool);
+    TJ(enableFrameReuse, asBool);
     TJ(debugDetachedCamera, asBool);
     TJ(debugEnableVirtualSurfaces, asBool);
     TJ(debugEnableSri, asBool);
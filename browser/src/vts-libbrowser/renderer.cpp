@@ -29,8 +29,13 @@
 namespace vts
 {
 
+MapImpl::Renderer::LastFrame::LastFrame() :
+    windowWidth(0), windowHeight(0), stateEpoch(0), infographics(0),
+    settled(false)
+{}
+
 MapImpl::Renderer::Renderer() :
-    windowWidth(0), windowHeight(0), tickIndex(0)
+    windowWidth(0), windowHeight(0), tickIndex(0), frameReused(false)
 {}
 
 void MapImpl::renderInitialize()
@@ -72,6 +77,16 @@ void MapImpl::purgeMapConfig()
 
     renderer.credits.purge();
     resources.searchTasks.clear();
+    for (auto &it : resources.seedTasks)
+    {
+        std::shared_ptr<SeedTask> t = it.lock();
+        if (t)
+        {
+            t->impl.reset();
+            t->done = true;
+        }
+    }
+    resources.seedTasks.clear();
     resetNavigationMode();
     navigation.autoRotation = 0;
     navigation.lastPositionAltitude.reset();
@@ -92,6 +107,7 @@ void MapImpl::purgeViewCache()
     layers.clear();
     statistics.resetFrame();
     draws = MapDraws();
+    renderer.lastFrame.settled = false;
     credits = MapCredits();
     mapConfigView = "";
     mapconfigReady = false;
@@ -115,33 +131,134 @@ void MapImpl::touchDraws(const std::vector<RenderTask> &renders)
 
 void MapImpl::touchDraws(TraverseNode *trav)
 {
-    for (auto &it : trav->opaque)
+    for (auto &it : trav->cold->opaque)
         touchDraws(it);
-    for (auto &it : trav->transparent)
+    for (auto &it : trav->cold->transparent)
         touchDraws(it);
-    if (trav->touchResource)
-        touchResource(trav->touchResource);
+    if (trav->cold->touchResource)
+        touchResource(trav->cold->touchResource);
 }
 
 bool MapImpl::visibilityTest(TraverseNode *trav)
 {
     assert(trav->meta);
+    if (trav->visibleTime == renderer.tickIndex)
+        return trav->visible;
     // aabb test
     if (!aabbTest(trav->aabbPhys, renderer.frustumPlanes))
         return false;
     // additional obb test
     if (trav->obb)
     {
-        TraverseNode::Obb &obb = *trav->obb;
-        vec4 planes[6];
-        frustumPlanes(renderer.viewProj * obb.rotInv, planes);
-        if (!aabbTest(obb.points, planes))
+        const TraverseNode::Obb &obb = *trav->obb;
+        if (!obbTest(obb.center, obb.axes, renderer.frustumPlanes))
             return false;
     }
     // all tests passed
     return true;
 }
 
+namespace
+{
+
+typedef Eigen::Array4d lanes;
+
+// boxes of up to four nodes in structure of arrays layout
+//   each plane is tested against all boxes at once
+struct BoxBatch
+{
+    lanes aabb[2][3];
+    lanes center[3];
+    lanes axes[3][3];
+    Eigen::Array<bool, 4, 1> hasObb;
+    uint32 count;
+
+    BoxBatch() : count(0)
+    {
+        // unused lanes are given an empty box at origin
+        for (uint32 i = 0; i < 3; i++)
+        {
+            aabb[0][i].setZero();
+            aabb[1][i].setZero();
+            center[i].setZero();
+            for (uint32 j = 0; j < 3; j++)
+                axes[i][j].setZero();
+        }
+        hasObb.setConstant(false);
+    }
+
+    void add(const TraverseNode *trav)
+    {
+        assert(count < 4);
+        for (uint32 i = 0; i < 3; i++)
+        {
+            aabb[0][i][count] = trav->aabbPhys[0][i];
+            aabb[1][i][count] = trav->aabbPhys[1][i];
+        }
+        if (trav->obb)
+        {
+            const TraverseNode::Obb &obb = *trav->obb;
+            for (uint32 i = 0; i < 3; i++)
+            {
+                center[i][count] = obb.center[i];
+                for (uint32 j = 0; j < 3; j++)
+                    axes[j][i][count] = obb.axes[j][i];
+            }
+            hasObb[count] = true;
+        }
+        count++;
+    }
+
+    // same results as aabbTest and obbTest
+    Eigen::Array<bool, 4, 1> test(const vec4 planes[6]) const
+    {
+        Eigen::Array<bool, 4, 1> visible;
+        visible.setConstant(true);
+        for (uint32 i = 0; i < 6; i++)
+        {
+            const vec4 &p = planes[i];
+            // the p-vertex selection is the same for all boxes
+            lanes d = aabb[p[0] > 0][0] * p[0]
+                    + aabb[p[1] > 0][1] * p[1]
+                    + aabb[p[2] > 0][2] * p[2];
+            visible = visible && !(d < -p[3]);
+            lanes r = (axes[0][0] * p[0] + axes[0][1] * p[1]
+                        + axes[0][2] * p[2]).abs()
+                    + (axes[1][0] * p[0] + axes[1][1] * p[1]
+                        + axes[1][2] * p[2]).abs()
+                    + (axes[2][0] * p[0] + axes[2][1] * p[1]
+                        + axes[2][2] * p[2]).abs();
+            lanes s = center[0] * p[0] + center[1] * p[1]
+                    + center[2] * p[2] + r;
+            visible = visible && (!hasObb || !(s < -p[3]));
+        }
+        return visible;
+    }
+};
+
+} // namespace
+
+void MapImpl::visibilityTestChilds(TraverseNode *trav)
+{
+    BoxBatch batch;
+    TraverseNode *nodes[4];
+    for (auto &it : trav->childs)
+    {
+        if (!it->meta)
+            continue; // tested individually later
+        nodes[batch.count] = it.get();
+        batch.add(it.get());
+    }
+    if (batch.count == 0)
+        return;
+    Eigen::Array<bool, 4, 1> visible = batch.test(renderer.frustumPlanes);
+    for (uint32 i = 0; i < batch.count; i++)
+    {
+        nodes[i]->visible = visible[i];
+        nodes[i]->visibleTime = renderer.tickIndex;
+    }
+}
+
 bool MapImpl::coarsenessTest(TraverseNode *trav)
 {
     assert(trav->meta);
@@ -150,44 +267,41 @@ bool MapImpl::coarsenessTest(TraverseNode *trav)
 
 double MapImpl::coarsenessValue(TraverseNode *trav)
 {
-    bool applyTexelSize = trav->meta->flags()
-            & vtslibs::vts::MetaNode::Flag::applyTexelSize;
-    bool applyDisplaySize = trav->meta->flags()
-            & vtslibs::vts::MetaNode::Flag::applyDisplaySize;
+    double texelSize = trav->texelSize;
+    if (texelSize == std::numeric_limits<double>::infinity())
+        return texelSize;
 
-    // the test fails by default
-    if (!applyTexelSize && !applyDisplaySize)
-        return std::numeric_limits<double>::infinity();
+    double result = coarsenessKernel(renderer.coarseness,
+                                     trav->cornersPhys, texelSize);
 
-    double texelSize = 0;
-    if (applyTexelSize)
-    {
-        texelSize = trav->meta->texelSize;
-    }
-    else if (applyDisplaySize)
+#ifndef NDEBUG
+    // compare with the reference on a few nodes
+    //   (vts-browser-coarseness-check tests it on random cameras)
+    if ((trav->hash + renderer.tickIndex) % 64 == 0)
     {
-        vec3 s = trav->aabbPhys[1] - trav->aabbPhys[0];
-        double m = std::max(s[0], std::max(s[1], s[2]));
-        if (m == std::numeric_limits<double>::infinity())
-            return m;
-        texelSize = m / trav->meta->displaySize;
+        double ref = coarsenessValueReference(trav);
+        if (std::abs(result - ref) > 1e-2 * std::max(ref, 1.0))
+        {
+            LOG(warn1) << "Coarseness kernel result " << result
+                       << " differs from reference " << ref;
+        }
     }
+#endif
 
-    // test the value on all corners of node bounding box
-    double result = 0;
-    vec3 up = renderer.perpendicularUnitVector * texelSize;
-    for (const vec3 &c : trav->cornersPhys)
-    {
-        vec3 c1 = c - up * 0.5;
-        vec3 c2 = c1 + up;
-        c1 = vec4to3(renderer.viewProj * vec3to4(c1, 1), true);
-        c2 = vec4to3(renderer.viewProj * vec3to4(c2, 1), true);
-        double len = std::abs(c2[1] - c1[1]) * renderer.windowHeight * 0.5;
-        result = std::max(result, len);
-    }
     return result;
 }
 
+// debug builds compare coarsenessValue with it
+double MapImpl::coarsenessValueReference(TraverseNode *trav)
+{
+    double texelSize = trav->texelSize;
+    if (texelSize == std::numeric_limits<double>::infinity())
+        return texelSize;
+    return coarsenessReference(renderer.viewProj,
+                renderer.perpendicularUnitVector, renderer.windowHeight,
+                trav->cornersPhys, texelSize);
+}
+
 void MapImpl::renderNode(TraverseNode *trav, const vec4f &uvClip)
 {
     assert(trav->meta);
@@ -205,26 +319,26 @@ void MapImpl::renderNode(TraverseNode *trav, const vec4f &uvClip)
     // meshes
     if (options.debugRenderMeshes)
     {
-        for (const RenderTask &r : trav->opaque)
+        for (const RenderTask &r : trav->cold->opaque)
             draws.opaque.emplace_back(r, uvClip.data(), this);
-        for (const RenderTask &r : trav->transparent)
+        for (const RenderTask &r : trav->cold->transparent)
             draws.transparent.emplace_back(r, uvClip.data(), this);
     }
 
     // geodata
     if (options.debugRenderGeodata)
     {
-        for (const RenderTask &r : trav->geodata)
+        for (const RenderTask &r : trav->cold->geodata)
             draws.geodata.emplace_back(r, uvClip.data(), this);
     }
 
     // surrogate
-    if (options.debugRenderSurrogates && trav->surrogatePhys)
+    if (options.debugRenderSurrogates && trav->cold->surrogatePhys)
     {
         RenderTask task;
         task.mesh = getMesh("internal://data/meshes/sphere.obj");
         task.mesh->priority = std::numeric_limits<float>::infinity();
-        task.model = translationMatrix(*trav->surrogatePhys)
+        task.model = translationMatrix(*trav->cold->surrogatePhys)
                 * scaleMatrix(trav->nodeInfo.extents().size() * 0.03);
         task.color = vec3to4f(trav->surface->color, task.color(3));
         if (task.ready())
@@ -234,7 +348,7 @@ void MapImpl::renderNode(TraverseNode *trav, const vec4f &uvClip)
     // mesh box
     if (options.debugRenderMeshBoxes)
     {
-        for (RenderTask &r : trav->opaque)
+        for (RenderTask &r : trav->cold->opaque)
         {
             RenderTask task;
             task.model = r.model;
@@ -288,7 +402,7 @@ void MapImpl::renderNode(TraverseNode *trav, const vec4f &uvClip)
     }
 
     // credits
-    for (auto &it : trav->credits)
+    for (auto &it : trav->cold->credits)
         renderer.credits.hit(trav->layer->creditScope, it,
                              trav->nodeInfo.distanceFromRoot());
 
@@ -418,19 +532,97 @@ void MapImpl::renderTickPrepare(double elapsedTime)
 
     updateNavigation(elapsedTime);
     updateSearch();
+    updateSeeds();
     updateSris();
-    for (auto &it : layers)
-        traverseClearing(it->traverseRoot.get());
+
+    // no nodes were accessed while the previous frame was reused
+    if (!renderer.frameReused)
+    {
+        for (auto &it : layers)
+            traverseClearing(it.get());
+    }
+}
+
+namespace
+{
+
+// options that affect the traversal or the draws
+bool renderOptionsEqual(const MapOptions &a, const MapOptions &b)
+{
+    return a.maxTexelToPixelScale == b.maxTexelToPixelScale
+        && a.maxTexelToPixelScaleBalancedAddition
+            == b.maxTexelToPixelScaleBalancedAddition
+        && a.renderTilesScale == b.renderTilesScale
+        && a.traverseModeSurfaces == b.traverseModeSurfaces
+        && a.traverseModeGeodata == b.traverseModeGeodata
+        && a.debugEnableVirtualSurfaces == b.debugEnableVirtualSurfaces
+        && a.debugFlatShading == b.debugFlatShading
+        && a.debugRenderSurrogates == b.debugRenderSurrogates
+        && a.debugRenderMeshBoxes == b.debugRenderMeshBoxes
+        && a.debugRenderTileBoxes == b.debugRenderTileBoxes
+        && a.debugRenderAltitudeShiftCorners
+            == b.debugRenderAltitudeShiftCorners
+        && a.debugRenderMeshes == b.debugRenderMeshes
+        && a.debugRenderGeodata == b.debugRenderGeodata;
+}
+
+} // namespace
+
+bool MapImpl::frameReusable()
+{
+    // the camera is compared only after it is updated
+    const Renderer::LastFrame &l = renderer.lastFrame;
+    return options.enableFrameReuse
+        && l.settled
+        && l.stateEpoch == resources.stateEpoch
+        && l.windowWidth == renderer.windowWidth
+        && l.windowHeight == renderer.windowHeight
+        && l.infographics <= draws.infographics.size()
+        && navigation.renders.empty()
+        && !options.debugDetachedCamera
+        && !options.debugRenderObjectPosition
+        && !options.debugRenderTargetPosition
+        && renderOptionsEqual(l.options, options);
 }
 
 void MapImpl::renderTickRender()
 {
-    draws.clear();
+    Renderer::LastFrame &l = renderer.lastFrame;
+    renderer.frameReused = false;
 
     if (!mapconfigReady || renderer.windowWidth == 0 || renderer.windowHeight == 0)
+    {
+        draws.clear();
+        l.settled = false;
         return;
+    }
+
+    if (frameReusable())
+    {
+        // remove infographics added by the application
+        draws.infographics.erase(draws.infographics.begin() + l.infographics,
+                                 draws.infographics.end());
+        updateCamera();
+        if (renderer.viewProjRender == l.viewProjRender
+                && renderer.viewRender == l.viewRender)
+        {
+            // keep the resources alive as if they were traversed
+            touchResourcesRepeat();
+            renderer.frameReused = true;
+            statistics.framesReused++;
+            return;
+        }
+        draws.clear();
+    }
+    else
+    {
+        draws.clear();
+        updateCamera();
+    }
+
+    // any change in resources during the traversal invalidates the frame
+    l.stateEpoch = resources.stateEpoch;
 
-    updateCamera();
     for (auto &it : layers)
         traverseRender(it->traverseRoot.get());
     renderer.credits.tick(credits);
@@ -438,6 +630,17 @@ void MapImpl::renderTickRender()
         draws.infographics.emplace_back(r, this);
 
     draws.sortOpaqueFrontToBack();
+
+    l.options = options;
+    l.viewProjRender = renderer.viewProjRender;
+    l.viewRender = renderer.viewRender;
+    l.windowWidth = renderer.windowWidth;
+    l.windowHeight = renderer.windowHeight;
+    l.infographics = draws.infographics.size();
+    l.touched = resources.touched;
+    l.settled = resources.touchedUnsettled == 0
+            && statistics.currentNodeMetaUpdates == 0
+            && statistics.currentNodeDrawsUpdates == 0;
 }
 
 namespace
@@ -549,6 +752,9 @@ void MapImpl::updateCamera()
         frustumPlanes(renderer.viewProj, renderer.frustumPlanes);
         renderer.cameraPosPhys = cameraPos;
         renderer.focusPosPhys = objCenter;
+        renderer.coarseness = CoarsenessCamera(renderer.viewProj,
+                    renderer.perpendicularUnitVector, cameraPos,
+                    renderer.windowHeight);
     }
     else
     {
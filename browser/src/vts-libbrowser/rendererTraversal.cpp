@@ -41,6 +41,29 @@ vec3 lowerUpperCombine(uint32 i)
     return res;
 }
 
+// texel size used by the coarseness test
+//   infinity if the test always fails
+double nodeTexelSize(const TraverseNode *trav)
+{
+    bool applyTexelSize = trav->meta->flags()
+            & vtslibs::vts::MetaNode::Flag::applyTexelSize;
+    bool applyDisplaySize = trav->meta->flags()
+            & vtslibs::vts::MetaNode::Flag::applyDisplaySize;
+
+    // the test fails by default
+    if (!applyTexelSize && !applyDisplaySize)
+        return std::numeric_limits<double>::infinity();
+
+    if (applyTexelSize)
+        return trav->meta->texelSize;
+
+    vec3 s = trav->aabbPhys[1] - trav->aabbPhys[0];
+    double m = std::max(s[0], std::max(s[1], s[2]));
+    if (m == std::numeric_limits<double>::infinity())
+        return m;
+    return m / trav->meta->displaySize;
+}
+
 } // namespace
 
 double MapImpl::travDistance(TraverseNode *trav, const vec3 pointPhys)
@@ -76,7 +99,10 @@ std::shared_ptr<GpuTexture> MapImpl::travInternalTexture(TraverseNode *trav,
     UrlTemplate::Vars vars(trav->nodeInfo.nodeId(),
             vtslibs::vts::local(trav->nodeInfo), subMeshIndex);
     std::shared_ptr<GpuTexture> res = getTexture(
-                trav->surface->urlIntTex(vars));
+                ResourceKey(trav->surface->keySource,
+                            ResourceKey::Slot::InternalTexture,
+                            trav->nodeInfo.nodeId(), subMeshIndex),
+                trav->surface->urlIntTex, vars);
     res->updatePriority(trav->priority);
     return res;
 }
@@ -110,7 +136,7 @@ bool MapImpl::travDetermineMeta(TraverseNode *trav)
         if (trav->parent)
         {
             const std::shared_ptr<MetaTile> &p
-                    = trav->parent->metaTiles[i];
+                    = trav->parent->cold->metaTiles[i];
             if (!p)
                 continue;
             TileId pid = vtslibs::vts::parent(nodeId);
@@ -120,8 +146,11 @@ bool MapImpl::travDetermineMeta(TraverseNode *trav)
                  & (vtslibs::vts::MetaNode::Flag::ulChild << idx)) == 0)
                 continue;
         }
-        auto m = getMetaTile(trav->layer->surfaceStack.surfaces[i]
-                             .urlMeta(tileIdVars));
+        const SurfaceInfo &surface = trav->layer->surfaceStack.surfaces[i];
+        auto m = getMetaTile(ResourceKey(surface.keySource,
+                                         ResourceKey::Slot::MetaTile,
+                                         tileIdVars.tileId),
+                             surface.urlMeta, tileIdVars);
         m->updatePriority(trav->priority);
         switch (getResourceValidity(m))
         {
@@ -173,8 +202,9 @@ bool MapImpl::travDetermineMeta(TraverseNode *trav)
     if (!node)
         return false; // all surfaces failed to download, what can i do?
 
-    trav->meta = *node;
-    trav->metaTiles.swap(metaTiles);
+    trav->cold->meta = *node;
+    trav->meta = &*trav->cold->meta;
+    trav->cold->metaTiles.swap(metaTiles);
     travDetermineMetaImpl(trav);
 
     // surface
@@ -183,7 +213,7 @@ bool MapImpl::travDetermineMeta(TraverseNode *trav)
         trav->surface = topmost;
         // credits
         for (auto it : node->credits())
-            trav->credits.push_back(it);
+            trav->cold->credits.push_back(it);
     }
 
     // prepare children
@@ -191,7 +221,7 @@ bool MapImpl::travDetermineMeta(TraverseNode *trav)
     for (uint32 i = 0; i < 4; i++)
     {
         if (childsAvailable[i])
-            trav->childs.push_back(std::make_shared<TraverseNode>(
+            trav->childs.push_back(TraverseNode::create(
                     trav->layer, trav, trav->nodeInfo.child(childs[i])));
     }
 
@@ -241,20 +271,25 @@ void MapImpl::travDetermineMetaImpl(TraverseNode *trav)
             vec3 u = corners[2] - corners[0];
             mat4 t = lookAt(center, center + f, u);
 
-            TraverseNode::Obb obb;
-            obb.rotInv = t.inverse();
             double di = std::numeric_limits<double>::infinity();
             vec3 vi(di, di, di);
-            obb.points[0] = vi;
-            obb.points[1] = -vi;
-
+            vec3 points[2] = { vi, -vi };
             for (uint32 i = 0; i < 8; i++)
             {
                 vec3 p = vec4to3(t * vec3to4(corners[i], 1), false);
-                obb.points[0] = min(obb.points[0], p);
-                obb.points[1] = max(obb.points[1], p);
+                points[0] = min(points[0], p);
+                points[1] = max(points[1], p);
             }
 
+            // the box is stored in physical space so that
+            //   the frustum planes need not be transformed for each node
+            mat4 rotInv = t.inverse();
+            vec3 half = (points[1] - points[0]) * 0.5;
+            TraverseNode::Obb obb;
+            obb.center = vec4to3(rotInv
+                    * vec3to4((points[0] + points[1]) * 0.5, 1), false);
+            for (uint32 i = 0; i < 3; i++)
+                obb.axes[i] = rotInv.block<3, 1>(0, i) * half[i];
             trav->obb = obb;
         }
     }
@@ -296,11 +331,13 @@ void MapImpl::travDetermineMetaImpl(TraverseNode *trav)
         vec2 exL = vecFromUblas<vec2>(trav->nodeInfo.extents().ll);
         vec3 sds = vec2to3((exU + exL) * 0.5,
                            trav->meta->geomExtents.surrogate);
-        trav->surrogatePhys = convertor->convert(sds,
+        trav->cold->surrogatePhys = convertor->convert(sds,
                             trav->nodeInfo.node(), Srs::Physical);
-        trav->surrogateNav = convertor->convert(sds,
+        trav->cold->surrogateNav = convertor->convert(sds,
                             trav->nodeInfo.node(), Srs::Navigation)[2];
     }
+
+    trav->texelSize = nodeTexelSize(trav);
 }
 
 bool MapImpl::travDetermineDraws(TraverseNode *trav)
@@ -326,11 +363,13 @@ bool MapImpl::travDetermineDrawsSurface(TraverseNode *trav)
     const TileId nodeId = trav->nodeInfo.nodeId();
 
     // aggregate mesh
-    std::string meshAggName = trav->surface->urlMesh(
+    std::shared_ptr<MeshAggregate> meshAgg = getMeshAggregate(
+            ResourceKey(trav->surface->keySource,
+                        ResourceKey::Slot::Mesh, nodeId),
+            trav->surface->urlMesh,
             UrlTemplate::Vars(nodeId, vtslibs::vts::local(trav->nodeInfo)));
-    std::shared_ptr<MeshAggregate> meshAgg = getMeshAggregate(meshAggName);
     meshAgg->updatePriority(trav->priority);
-    switch (getResourceValidity(meshAggName))
+    switch (getResourceValidity(meshAgg))
     {
     case Validity::Invalid:
         trav->surface = nullptr;
@@ -435,14 +474,14 @@ bool MapImpl::travDetermineDrawsSurface(TraverseNode *trav)
     if (determined)
     {
         assert(trav->rendersEmpty());
-        std::swap(trav->opaque, newOpaque);
-        std::swap(trav->transparent, newTransparent);
-        trav->credits.insert(trav->credits.end(),
+        std::swap(trav->cold->opaque, newOpaque);
+        std::swap(trav->cold->transparent, newTransparent);
+        trav->cold->credits.insert(trav->cold->credits.end(),
                              newCredits.begin(), newCredits.end());
         if (trav->rendersEmpty())
             trav->surface = nullptr;
         else
-            trav->touchResource = meshAgg;
+            trav->cold->touchResource = meshAgg;
     }
 
     return determined;
@@ -485,12 +524,12 @@ bool MapImpl::travDetermineDrawsGeodata(TraverseNode *trav)
     assert(trav->rendersEmpty());
 
     for (auto it : geo->renders)
-        trav->geodata.push_back(it);
+        trav->cold->geodata.push_back(it);
 
     if (trav->rendersEmpty())
         trav->surface = nullptr;
     else
-        trav->touchResource = geo;
+        trav->cold->touchResource = geo;
     return true;
 }
 
@@ -556,6 +595,8 @@ void MapImpl::travModeHierarchical(TraverseNode *trav, bool loadOnly)
             ok = false;
     }
 
+    if (ok)
+        visibilityTestChilds(trav);
     for (auto &t : trav->childs)
         travModeHierarchical(t.get(), !ok);
 
@@ -586,6 +627,7 @@ void MapImpl::travModeFlat(TraverseNode *trav)
 
     trav->clearRenders();
 
+    visibilityTestChilds(trav);
     for (auto &t : trav->childs)
         travModeFlat(t.get());
 }
@@ -627,6 +669,7 @@ void MapImpl::travModeBalanced(TraverseNode *trav)
         return;
     }
 
+    visibilityTestChilds(trav);
     for (auto &t : trav->childs)
         travModeBalanced(t.get());
 }
@@ -648,16 +691,32 @@ void MapImpl::traverseRender(TraverseNode *trav)
     }
 }
 
-void MapImpl::traverseClearing(TraverseNode *trav)
+void MapImpl::traverseClearing(MapLayer *layer)
 {
-    if (trav->lastAccessTime + 5 < renderer.tickIndex)
+    // the sweep continues where it stopped in the previous tick
+    // the stack cannot reference any cleared node,
+    //   because the children are pushed only after their parent was checked
+    //   and only the clearing removes nodes from the tree
+    std::vector<TraverseNode*> &stack = layer->clearingStack;
+    if (stack.empty())
+        stack.push_back(layer->traverseRoot.get());
+    uint32 budget = options.maxTraverseClearingPerTick;
+    uint32 swept = 0;
+    while (!stack.empty() && (budget == 0 || swept < budget))
     {
-        trav->clearAll();
-        return;
+        TraverseNode *trav = stack.back();
+        stack.pop_back();
+        swept++;
+        if (trav->lastAccessTime + 5 < renderer.tickIndex)
+        {
+            trav->clearAll();
+            statistics.nodesCleared++;
+            continue;
+        }
+        for (auto &it : trav->childs)
+            stack.push_back(it.get());
     }
-
-    for (auto &it : trav->childs)
-        traverseClearing(it.get());
+    statistics.currentNodesSwept += swept;
 }
 
 } // namespace vts
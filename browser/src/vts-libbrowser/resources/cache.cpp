@@ -24,15 +24,29 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cstddef> // offsetof
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <boost/filesystem.hpp>
+#include <boost/crc.hpp>
+#include <boost/thread/lock_guard.hpp>
 #include <utility/path.hpp> // homeDir
 #include <utility/md5.hpp>
 #include <dbglog/dbglog.hpp>
+#include <zlib.h>
 
 #include "../include/vts-browser/options.hpp"
+#include "../include/vts-browser/statistics.hpp"
+#include "../include/vts-browser/log.hpp"
 
 #include "cache.hpp"
 
+#ifndef _WIN32
+#include <sys/mman.h> // mmap
+#include <unistd.h> // sysconf, pread
+#endif
+
 namespace vts
 {
 
@@ -40,7 +54,28 @@ namespace
 {
 
 static const char Magic[] = "vtscache";
-static const uint16 Version = 3;
+static const char StateMagic[] = "vtscstate";
+static const uint16 Version = 6;
+
+// name of the file with the name filter and the disk use
+//   saved between runs, entries are never stored in the root directory
+static const char StateFileName[] = "state";
+
+// trimming walks the directories until it has seen this many times
+//   the size to be evicted, the oldest of these files are evicted
+static const uint32 TrimSampleRatio = 3;
+
+// smaller reads are copied, which is faster than mapping
+static const uint32 MappedReadThreshold = 64 * 1024;
+
+// compressing tiny entries does not pay off
+static const uint32 MinCompressedSize = 64;
+
+// reading an entry updates its access time at most this often
+static const sint64 AccessTouchSeconds = 60 * 60;
+
+// increment when the layout of decoded meshes or textures changes
+static const uint32 CacheDecodedVersion = 1;
 
 struct CacheHeader
 {
@@ -48,6 +83,96 @@ struct CacheHeader
     uint16 version;
     sint64 expires;
     uint16 nameLen;
+    uint16 resourceType;
+    uint32 rawSize; // zero for uncompressed entries
+    uint16 validatorsLen;
+};
+
+// bloom filter of the names of the cached entries
+class NameFilter
+{
+public:
+    NameFilter(uint64 capacity) :
+        capacity(std::max<uint64>(capacity, 1024)), count(0)
+    {
+        data.resize(this->capacity * BitsPerName / 64 + 1);
+    }
+
+    void insert(const std::string &name)
+    {
+        uint64 a, b;
+        hashes(name, a, b);
+        uint64 bits = data.size() * 64;
+        for (uint32 i = 0; i < HashesCount; i++)
+        {
+            uint64 h = (a + i * b) % bits;
+            data[h / 64] |= (uint64)1 << (h % 64);
+        }
+        count++;
+    }
+
+    bool contains(const std::string &name) const
+    {
+        uint64 a, b;
+        hashes(name, a, b);
+        uint64 bits = data.size() * 64;
+        for (uint32 i = 0; i < HashesCount; i++)
+        {
+            uint64 h = (a + i * b) % bits;
+            if ((data[h / 64] & ((uint64)1 << (h % 64))) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    bool full() const
+    {
+        return count > capacity;
+    }
+
+    // the filter is saved in the state file between runs
+    void save(std::ostream &o) const
+    {
+        o.write((const char*)&capacity, sizeof(capacity));
+        o.write((const char*)&count, sizeof(count));
+        o.write((const char*)data.data(), data.size() * sizeof(uint64));
+    }
+
+    static std::unique_ptr<NameFilter> load(std::istream &i)
+    {
+        uint64 capacity = 0, count = 0;
+        i.read((char*)&capacity, sizeof(capacity));
+        i.read((char*)&count, sizeof(count));
+        if (!i || capacity < 1024 || capacity > ((uint64)1 << 32))
+            return nullptr;
+        std::unique_ptr<NameFilter> f(new NameFilter(capacity));
+        f->count = count;
+        i.read((char*)f->data.data(), f->data.size() * sizeof(uint64));
+        if (!i)
+            return nullptr;
+        return f;
+    }
+
+private:
+    // about 1 % false positives
+    static const uint32 BitsPerName = 10;
+    static const uint32 HashesCount = 7;
+
+    // the hashes must not change between runs, the filter is saved
+    static void hashes(const std::string &name, uint64 &a, uint64 &b)
+    {
+        a = 14695981039346656037ull; // fnv-1a
+        for (char c : name)
+            a = (a ^ (unsigned char)c) * 1099511628211ull;
+        b = a + 0x9e3779b97f4a7c15ull; // splitmix64
+        b = (b ^ (b >> 30)) * 0xbf58476d1ce4e5b9ull;
+        b = (b ^ (b >> 27)) * 0x94d049bb133111ebull;
+        b = (b ^ (b >> 31)) | 1;
+    }
+
+    std::vector<uint64> data;
+    const uint64 capacity;
+    uint64 count;
 };
 
 char digit(unsigned char a)
@@ -62,46 +187,85 @@ class CacheImpl : public Cache
 {
 public:
     CacheImpl(const MapCreateOptions &options) :
-        root(options.cachePath), disabled(options.disableCache),
-        hashes(options.hashCachePaths)
+        maxSize((uint64)options.cacheMaxSizeMB * 1024 * 1024),
+        diskUse(0), evicted(0), hits(0), misses(0), falsePositives(0),
+        scanning(false),
+        disabled(options.disableCache),
+        hashes(options.hashCachePaths),
+        compression(options.cacheCompression),
+        trimCursor(0)
     {
         if (!disabled)
         {
-            if (root.empty())
-            {
-                root = utility::homeDir().string();
-                if (root.empty())
-                {
-                    LOGTHROW(err3, std::runtime_error)
-                        << "invalid home dir, the cache path must be defined";
-                }
-                root += "/.cache/vts-browser/";
-            }
-            if (root.back() != '/')
-                root += "/";
+            root = cacheRootPath(options);
             LOG(info2) << "Disk cache path: <" << root << ">";
+            loadState();
+            // without the saved state, the first scan builds the name filter
+            trimmer.reset(new CacheTrimmer(
+                [this](const CacheTrimmer &t) { trim(t); }));
         }
     }
 
-    void write(std::string name,
-               const Buffer &buffer, sint64 expires) override
+    ~CacheImpl()
+    {
+        trimmer.reset();
+        if (!disabled)
+            saveState();
+    }
+
+    void write(std::string name, const Buffer &buffer, sint64 expires,
+               FetchTask::ResourceType type,
+               const CacheValidators &validators) override
     {
         if (disabled)
             return;
-        name = stripScheme(name);
+        name = cacheStripScheme(name);
         try
         {
-            Buffer b(sizeof(CacheHeader) + name.size() + buffer.size());
+            Buffer compressed;
+            uint32 rawSize = compression
+                    ? cacheCompress(buffer, compressed, type) : 0;
+            const Buffer &payload = rawSize ? compressed : buffer;
+            std::string v = validators.encode();
+            Buffer b(sizeof(CacheHeader) + name.size() + v.size()
+                     + payload.size());
             memset(b.data(), 0, sizeof(CacheHeader)); // initialize structure padding
             CacheHeader *h = (CacheHeader*)b.data();
             memcpy(h->magic, Magic, sizeof(Magic));
             h->version = Version;
             h->expires = expires;
             h->nameLen = name.size();
-            memcpy(b.data() + sizeof(CacheHeader), name.data(), name.size());
-            memcpy(b.data() + sizeof(CacheHeader) + name.size(),
-                   buffer.data(), buffer.size());
-            writeLocalFileBuffer(convertNameToCache(name), b);
+            h->resourceType = (uint16)type;
+            h->rawSize = rawSize;
+            h->validatorsLen = v.size();
+            char *p = b.data() + sizeof(CacheHeader);
+            memcpy(p, name.data(), name.size());
+            p += name.size();
+            memcpy(p, v.data(), v.size());
+            p += v.size();
+            memcpy(p, payload.data(), payload.size());
+            std::string cn = convertNameToCache(name);
+            // an overwritten entry is accounted only by the difference
+            boost::system::error_code ec;
+            uint64 old = boost::filesystem::file_size(cn, ec);
+            if (ec)
+                old = 0;
+            writeLocalFileBuffer(cn, b);
+            bool wake = false;
+            {
+                boost::lock_guard<boost::mutex> l(mutFilter);
+                if (filter)
+                {
+                    filter->insert(name);
+                    wake = filter->full();
+                }
+                if (scanning)
+                    scannedNames.push_back(name);
+            }
+            diskUse += b.size();
+            diskUse -= std::min<uint64>(old, diskUse);
+            if (wake || (maxSize > 0 && diskUse > maxSize))
+                trimmer->wake();
         }
         catch (...)
         {
@@ -115,47 +279,168 @@ public:
         assert(buffer.size() == 0);
         if (disabled)
             return false;
-        name = stripScheme(name);
+        name = cacheStripScheme(name);
+        bool filtered = false;
+        {
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            if (filter)
+            {
+                if (!filter->contains(name))
+                {
+                    misses++;
+                    return false;
+                }
+                filtered = true;
+            }
+        }
         std::string cn = convertNameToCache(name);
-        if (!boost::filesystem::exists(cn))
+        FILE *f = fopen(cn.c_str(), "rb");
+        if (!f)
+        {
+            if (filtered)
+                falsePositives++;
+            misses++;
             return false;
+        }
         try
         {
-            Buffer b = readLocalFileBuffer(cn);
-            if (b.size() < sizeof(CacheHeader))
-                return false;
-            CacheHeader *h = (CacheHeader*)b.data();
-            if (memcmp(h->magic, Magic, sizeof(Magic)) != 0)
-                return false;
-            if (h->version != Version)
-                return false;
-            expires = h->expires;
-            if (expires == -2)
-                return false; // must revalidate
-            if (expires > 0 && expires < std::time(nullptr))
-                return false;
-            if (name.size() != h->nameLen)
-                return false;
-            if (b.size() < sizeof(CacheHeader) + h->nameLen)
-                return false;
-            if (memcmp(b.data() + sizeof(CacheHeader),
-                       name.data(), h->nameLen) != 0)
-                return false;
-            uint32 size = b.size() - sizeof(CacheHeader) - h->nameLen;
-            if (size > 0)
+            bool res = readEntry(f, name, buffer, expires);
+            fclose(f);
+            if (res && maxSize > 0)
             {
-                buffer.allocate(size);
-                memcpy(buffer.data(), b.data()
-                       + sizeof(CacheHeader) + h->nameLen, size);
+                // the modification time is used for the access tracking
+                //   it is updated only when it is noticeably old
+                boost::system::error_code ec;
+                std::time_t now = std::time(nullptr);
+                std::time_t t = boost::filesystem::last_write_time(cn, ec);
+                if (!ec && t + AccessTouchSeconds < now)
+                    boost::filesystem::last_write_time(cn, now, ec);
             }
-            return true;
+            (res ? hits : misses)++;
+            return res;
+        }
+        catch (...)
+        {
+            fclose(f);
+            misses++;
+            return false;
+        }
+    }
+
+    bool readEntry(FILE *f, const std::string &name,
+              Buffer &buffer, sint64 &expires)
+    {
+        CacheHeader h;
+        std::string validators;
+        if (!readEntryHeader(f, name, h, validators))
+            return false;
+        expires = h.expires;
+        if (expires == -2)
+            return false; // must revalidate
+        if (expires > 0 && expires < std::time(nullptr))
+            return false;
+        return readEntryPayload(f, h, buffer);
+    }
+
+    bool validators(std::string name,
+                    CacheValidators &validators) override
+    {
+        if (disabled)
+            return false;
+        name = cacheStripScheme(name);
+        if (!mayContain(name))
+            return false;
+        FILE *f = fopen(convertNameToCache(name).c_str(), "rb");
+        if (!f)
+            return false;
+        CacheHeader h;
+        std::string v;
+        bool res = readEntryHeader(f, name, h, v);
+        fclose(f);
+        if (!res)
+            return false;
+        validators.decode(v);
+        return !validators.empty();
+    }
+
+    bool revalidate(std::string name, sint64 expires,
+                    Buffer *content) override
+    {
+        if (disabled)
+            return false;
+        name = cacheStripScheme(name);
+        if (!mayContain(name))
+            return false;
+        FILE *f = fopen(convertNameToCache(name).c_str(), "r+b");
+        if (!f)
+            return false;
+        try
+        {
+            // update the expiration in place
+            CacheHeader h;
+            std::string v;
+            bool res = readEntryHeader(f, name, h, v)
+                && fseek(f, offsetof(CacheHeader, expires), SEEK_SET) == 0
+                && fwrite(&expires, sizeof(expires), 1, f) == 1;
+            if (res && content)
+                res = readEntryPayload(f, h, *content);
+            fclose(f);
+            return res;
         }
         catch (...)
         {
+            fclose(f);
             return false;
         }
     }
 
+    bool mayContain(const std::string &name)
+    {
+        boost::lock_guard<boost::mutex> l(mutFilter);
+        return !filter || filter->contains(name);
+    }
+
+    // validates the header and the name and reads the validators
+    bool readEntryHeader(FILE *f, const std::string &name,
+                         CacheHeader &h, std::string &validators)
+    {
+        if (fread(&h, sizeof(CacheHeader), 1, f) != 1)
+            return false;
+        if (memcmp(h.magic, Magic, sizeof(Magic)) != 0)
+            return false;
+        if (h.version != Version)
+            return false;
+        if (name.size() != h.nameLen)
+            return false;
+        std::string n(h.nameLen, 0);
+        if (h.nameLen > 0 && fread(&n[0], h.nameLen, 1, f) != 1)
+            return false;
+        if (n != name)
+            return false;
+        validators.resize(h.validatorsLen);
+        if (h.validatorsLen > 0
+                && fread(&validators[0], h.validatorsLen, 1, f) != 1)
+            return false;
+        return true;
+    }
+
+    // reads the payload directly into the buffer
+    bool readEntryPayload(FILE *f, const CacheHeader &h, Buffer &buffer)
+    {
+        if (fseek(f, 0, SEEK_END) != 0)
+            return false;
+        uint64 offset = sizeof(CacheHeader) + h.nameLen + h.validatorsLen;
+        uint64 fileSize = ftell(f);
+        if (fileSize < offset)
+            return false;
+        uint32 size = fileSize - offset;
+        if (size > 0)
+            buffer = cacheReadFile(f, offset, size);
+        if (h.rawSize > 0)
+            buffer = cacheDecompress(buffer, h.rawSize);
+        return true;
+    }
+
     void purge() override
     {
         if (disabled)
@@ -163,6 +448,13 @@ public:
         LOG(info2) << "Purging disk cache";
         assert(root.length() > 0 && root[root.length() - 1] == '/');
         std::string op = root.substr(0, root.length() - 1);
+        {
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            filter.reset(new NameFilter(0));
+            scanning = false;
+            scannedNames.clear();
+            diskUse = 0;
+        }
         if (!boost::filesystem::exists(op))
             return;
         try
@@ -177,9 +469,298 @@ public:
         }
     }
 
+    void updateStatistics(MapStatistics &statistics) override
+    {
+        statistics.cacheDiskUseMB = diskUse / 1024 / 1024;
+        statistics.cacheEntriesEvicted = evicted;
+        statistics.cacheLookupHits = hits;
+        statistics.cacheLookupMisses = misses;
+        statistics.cacheLookupFalsePositives = falsePositives;
+    }
+
+    struct File
+    {
+        std::string path;
+        std::string name;
+        uint64 size;
+        sint64 key;
+    };
+
+    // the whole cache is scanned only when the name filter is missing
+    //   (no state saved by the previous run) or full
+    // otherwise only part of the cache is walked to evict old entries
+    void trim(const CacheTrimmer &t)
+    {
+        bool rescan = false;
+        {
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            rescan = !filter || filter->full();
+        }
+        if (rescan)
+            scan(t);
+        else if (maxSize > 0 && diskUse > maxSize)
+            evictSample(t);
+    }
+
+    // adds all files in the directory (recursively)
+    // returns false if the walk was interrupted
+    bool collect(const CacheTrimmer &t, const std::string &dir,
+                 std::vector<File> &files, uint64 &total)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::recursive_directory_iterator it(dir, ec), e;
+        for (; !ec && it != e; it.increment(ec))
+        {
+            if (t.stopping())
+                return false;
+            if (!boost::filesystem::is_regular_file(it->status()))
+                continue;
+            File f;
+            f.path = it->path().string();
+            if (f.path.find("_tmp_") != std::string::npos)
+                continue; // file in the middle of writing
+            if (f.path == root + StateFileName)
+                continue;
+            f.size = boost::filesystem::file_size(it->path(), ec);
+            if (ec)
+                continue;
+            f.key = boost::filesystem::last_write_time(it->path(), ec);
+            if (ec)
+                continue;
+            sint32 type = readHeader(f.path, f.name);
+            if (type < 0)
+                f.key = 0; // invalid or outdated files go first
+            else
+                f.key += CacheEvictionClassSeconds * cacheEvictionClass(
+                            (FetchTask::ResourceType)type);
+            total += f.size;
+            files.push_back(std::move(f));
+        }
+        if (ec && boost::filesystem::exists(dir))
+        {
+            LOG(warn2) << "Scanning disk cache failed: <"
+                       << ec.message() << ">";
+            return false;
+        }
+        return true;
+    }
+
+    // removes the oldest files until the total is at most the target
+    void evictOldest(const CacheTrimmer &t, std::vector<File> &files,
+                     uint64 &total, uint64 target)
+    {
+        std::sort(files.begin(), files.end(), [](
+                  const File &a, const File &b) {
+            return a.key < b.key;
+        });
+        boost::system::error_code ec;
+        uint32 cnt = 0;
+        for (File &f : files)
+        {
+            if (total <= target || t.stopping())
+                break;
+            if (boost::filesystem::remove(f.path, ec) && !ec)
+            {
+                total -= f.size;
+                f.name.clear();
+                cnt++;
+            }
+        }
+        evicted += cnt;
+        LOG(info2) << "Evicted " << cnt << " files from the disk cache";
+    }
+
+    // scans all files in the cache, rebuilds the name filter
+    //   and evicts the least recently used files
+    //   until the cache fits the limit
+    void scan(const CacheTrimmer &t)
+    {
+        std::vector<File> files;
+        uint64 total = 0;
+        {
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            scanning = true;
+            scannedNames.clear();
+        }
+        if (!collect(t, root, files, total))
+        {
+            // incomplete filter would hide existing entries
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            scanning = false;
+            scannedNames.clear();
+            return;
+        }
+        if (maxSize > 0 && total > maxSize)
+            evictOldest(t, files, total, maxSize * CacheTrimRatio);
+        diskUse = total;
+
+        // replace the name filter
+        std::unique_ptr<NameFilter> nf(new NameFilter(files.size() * 2));
+        for (const File &f : files)
+            if (!f.name.empty())
+                nf->insert(f.name);
+        boost::lock_guard<boost::mutex> l(mutFilter);
+        if (!scanning)
+            return; // purged in the meantime
+        for (const std::string &n : scannedNames)
+            nf->insert(n);
+        filter.swap(nf);
+        scanning = false;
+        scannedNames.clear();
+    }
+
+    // evicts the oldest files from a part of the cache
+    //   the top level directories are walked in turns, starting where
+    //   the previous trim stopped, until enough files are seen
+    // the entries are spread evenly over the directories,
+    //   so the part approximates the whole cache
+    void evictSample(const CacheTrimmer &t)
+    {
+        uint64 target = maxSize * CacheTrimRatio;
+        uint64 use = diskUse;
+        if (use <= target)
+            return;
+        uint64 need = use - target;
+        std::vector<std::string> dirs;
+        {
+            boost::system::error_code ec;
+            boost::filesystem::directory_iterator it(root, ec), e;
+            for (; !ec && it != e; it.increment(ec))
+                if (boost::filesystem::is_directory(it->status()))
+                    dirs.push_back(it->path().string());
+        }
+        if (dirs.empty())
+            return;
+        std::sort(dirs.begin(), dirs.end());
+        std::vector<File> files;
+        uint64 sampled = 0;
+        uint32 i = 0;
+        while (i < dirs.size() && sampled < need * TrimSampleRatio)
+        {
+            if (!collect(t, dirs[(trimCursor + i++) % dirs.size()],
+                         files, sampled))
+                return;
+        }
+        trimCursor = (trimCursor + i) % dirs.size();
+        uint64 remaining = sampled;
+        if (i == dirs.size())
+        {
+            // the whole cache was walked, the disk use is exact now
+            //   except for the files written during the walk
+            evictOldest(t, files, remaining, target);
+            uint64 now = diskUse;
+            diskUse = remaining + (now > use ? now - use : 0);
+            return;
+        }
+        evictOldest(t, files, remaining, sampled - need);
+        diskUse -= std::min<uint64>(sampled - remaining, diskUse);
+    }
+
+    // the name filter and the disk use are loaded from the previous run
+    // the file is removed, it is written again at a clean shutdown only
+    void loadState()
+    {
+        std::string path = root + StateFileName;
+        std::string data;
+        {
+            std::ifstream i(path, std::ios::binary);
+            if (!i)
+                return;
+            data.assign(std::istreambuf_iterator<char>(i),
+                        std::istreambuf_iterator<char>());
+        }
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+        if (data.size() < sizeof(StateMagic) + sizeof(uint16)
+                + sizeof(uint64) + sizeof(uint32))
+            return;
+        uint32 checksum = 0;
+        memcpy(&checksum, data.data() + data.size() - sizeof(checksum),
+               sizeof(checksum));
+        data.resize(data.size() - sizeof(checksum));
+        boost::crc_32_type crc;
+        crc.process_bytes(data.data(), data.size());
+        if (crc.checksum() != checksum)
+            return;
+        std::istringstream i(data);
+        char magic[sizeof(StateMagic)];
+        uint16 version = 0;
+        uint64 use = 0;
+        i.read(magic, sizeof(magic));
+        i.read((char*)&version, sizeof(version));
+        i.read((char*)&use, sizeof(use));
+        if (!i || memcmp(magic, StateMagic, sizeof(StateMagic)) != 0
+                || version != Version)
+            return;
+        std::unique_ptr<NameFilter> f = NameFilter::load(i);
+        if (!f)
+            return;
+        boost::lock_guard<boost::mutex> l(mutFilter);
+        filter.swap(f);
+        diskUse = use;
+    }
+
+    void saveState()
+    {
+        std::ostringstream o;
+        {
+            boost::lock_guard<boost::mutex> l(mutFilter);
+            if (!filter || scanning)
+                return; // the next run scans the cache
+            o.write(StateMagic, sizeof(StateMagic));
+            o.write((const char*)&Version, sizeof(Version));
+            uint64 use = diskUse;
+            o.write((const char*)&use, sizeof(use));
+            filter->save(o);
+        }
+        std::string data = o.str();
+        boost::crc_32_type crc;
+        crc.process_bytes(data.data(), data.size());
+        uint32 checksum = crc.checksum();
+        data.append((const char*)&checksum, sizeof(checksum));
+        try
+        {
+            boost::filesystem::create_directories(root);
+            std::string path = root + StateFileName;
+            std::string tmp = path + "_tmp_";
+            {
+                std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+                f.write(data.data(), data.size());
+                if (!f)
+                    return;
+            }
+            boost::filesystem::rename(tmp, path);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn2) << "Failed to save the disk cache state: <"
+                       << e.what() << ">";
+        }
+    }
+
+    // reads the name of the entry
+    // returns -1 for files that are not valid cache entries
+    static sint32 readHeader(const std::string &path, std::string &name)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            return -1;
+        CacheHeader h;
+        bool ok = fread(&h, sizeof(CacheHeader), 1, f) == 1
+                && memcmp(h.magic, Magic, sizeof(Magic)) == 0
+                && h.version == Version;
+        if (ok)
+        {
+            name.resize(h.nameLen);
+            ok = h.nameLen == 0 || fread(&name[0], h.nameLen, 1, f) == 1;
+        }
+        fclose(f);
+        return ok ? h.resourceType : -1;
+    }
+
     std::string convertNameToCache(const std::string &path)
     {
-        assert(path == stripScheme(path));
+        assert(path == cacheStripScheme(path));
         if (hashes)
         {
             unsigned char digest[16];
@@ -206,15 +787,22 @@ public:
         }
     }
 
-    std::string stripScheme(const std::string &name)
-    {
-        auto p = name.find("://");
-        return p == std::string::npos ? name : name.substr(p + 3);
-    }
-
     std::string root;
+    const uint64 maxSize;
+    std::atomic<uint64> diskUse;
+    std::atomic<uint32> evicted;
+    std::atomic<uint32> hits;
+    std::atomic<uint32> misses;
+    std::atomic<uint32> falsePositives;
+    std::unique_ptr<NameFilter> filter; // null until the first scan is done
+    std::vector<std::string> scannedNames; // written during the scan
+    boost::mutex mutFilter;
+    bool scanning;
     bool disabled;
     bool hashes;
+    bool compression;
+    uint32 trimCursor; // first directory of the next evictSample
+    std::unique_ptr<CacheTrimmer> trimmer;
 };
 
 } // namespace
@@ -222,9 +810,243 @@ public:
 Cache::~Cache()
 {}
 
+void Cache::sync()
+{}
+
+void Cache::updateStatistics(MapStatistics &)
+{}
+
+CacheTrimmer::CacheTrimmer(
+        const std::function<void(const CacheTrimmer &)> &trim) :
+    trim(trim), stop(false), work(true)
+{
+    thr = boost::thread(&CacheTrimmer::entry, this);
+}
+
+CacheTrimmer::~CacheTrimmer()
+{
+    {
+        boost::lock_guard<boost::mutex> l(mut);
+        stop = true;
+        cond.notify_all();
+    }
+    thr.join();
+}
+
+void CacheTrimmer::wake()
+{
+    boost::lock_guard<boost::mutex> l(mut);
+    work = true;
+    cond.notify_all();
+}
+
+void CacheTrimmer::entry()
+{
+    setLogThreadName("cache trimmer");
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> l(mut);
+            while (!stop && !work)
+                cond.wait(l);
+            if (stop)
+                return;
+            work = false;
+        }
+        try
+        {
+            trim(*this);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn3) << "Trimming disk cache failed: <" << e.what() << ">";
+        }
+    }
+}
+
+uint32 cacheEvictionClass(FetchTask::ResourceType type)
+{
+    switch (type)
+    {
+    // small resources that block the traversal
+    case FetchTask::ResourceType::MapConfig:
+    case FetchTask::ResourceType::AuthConfig:
+    case FetchTask::ResourceType::BoundLayerConfig:
+    case FetchTask::ResourceType::FreeLayerConfig:
+    case FetchTask::ResourceType::TilesetMappingConfig:
+    case FetchTask::ResourceType::GeodataStylesheet:
+    case FetchTask::ResourceType::MetaTile:
+    case FetchTask::ResourceType::BoundMetaTile:
+    case FetchTask::ResourceType::SriIndex:
+        return 3;
+    // the bulk of the data
+    case FetchTask::ResourceType::Mesh:
+    case FetchTask::ResourceType::Texture:
+    case FetchTask::ResourceType::GeodataFeatures:
+        return 2;
+    // recreated from the other entries without any download
+    case FetchTask::ResourceType::Decoded:
+        return 0;
+    // cheap to fetch again
+    default:
+        return 1;
+    }
+}
+
 std::shared_ptr<Cache> Cache::create(const MapCreateOptions &options)
 {
-    return std::make_shared<CacheImpl>(options);
+    std::shared_ptr<Cache> c;
+    if (options.packCacheFiles && !options.disableCache)
+        c = createPackCache(options);
+    else
+        c = std::make_shared<CacheImpl>(options);
+    if (options.cacheWriteQueueKB > 0 && !options.disableCache)
+        c = createCacheWriter(c, options);
+    return c;
+}
+
+uint32 cacheCompress(const Buffer &in, Buffer &out,
+                     FetchTask::ResourceType type)
+{
+    switch (type)
+    {
+    // images are compressed already
+    case FetchTask::ResourceType::Texture:
+    case FetchTask::ResourceType::NavTile:
+    case FetchTask::ResourceType::BoundMetaTile:
+        return 0;
+    // decoded data are read directly (memory mapped) from the cache
+    case FetchTask::ResourceType::Decoded:
+        return 0;
+    default:
+        break;
+    }
+    if (in.size() < MinCompressedSize)
+        return 0;
+    uLongf size = compressBound(in.size());
+    out.allocate(size);
+    if (compress2((Bytef*)out.data(), &size, (const Bytef*)in.data(),
+                  in.size(), Z_DEFAULT_COMPRESSION) != Z_OK
+            || size > in.size() - in.size() / 10)
+    {
+        out.free();
+        return 0; // not worth it
+    }
+    out.resize(size);
+    return in.size();
+}
+
+Buffer cacheDecompress(const Buffer &in, uint32 rawSize)
+{
+    Buffer out(rawSize);
+    uLongf size = rawSize;
+    if (uncompress((Bytef*)out.data(), &size, (const Bytef*)in.data(),
+                   in.size()) != Z_OK || size != rawSize)
+    {
+        LOGTHROW(err1, std::runtime_error)
+                << "Failed to decompress cache entry";
+    }
+    return out;
+}
+
+bool CacheValidators::empty() const
+{
+    return etag.empty() && lastModified.empty();
+}
+
+std::string CacheValidators::encode() const
+{
+    if (empty())
+        return "";
+    return etag + "\n" + lastModified;
+}
+
+void CacheValidators::decode(const std::string &str)
+{
+    auto p = str.find('\n');
+    if (p == std::string::npos)
+    {
+        etag.clear();
+        lastModified.clear();
+        return;
+    }
+    etag = str.substr(0, p);
+    lastModified = str.substr(p + 1);
+}
+
+std::string cacheRootPath(const MapCreateOptions &options)
+{
+    std::string root = options.cachePath;
+    if (root.empty())
+    {
+        root = utility::homeDir().string();
+        if (root.empty())
+        {
+            LOGTHROW(err3, std::runtime_error)
+                << "invalid home dir, the cache path must be defined";
+        }
+        root += "/.cache/vts-browser/";
+    }
+    if (root.back() != '/')
+        root += "/";
+    return root;
+}
+
+std::string cacheStripScheme(const std::string &name)
+{
+    auto p = name.find("://");
+    return p == std::string::npos ? name : name.substr(p + 3);
+}
+
+Buffer cacheReadFile(FILE *f, uint64 offset, uint32 size)
+{
+#ifndef _WIN32
+    if (size >= MappedReadThreshold)
+    {
+        static const uint64 page = sysconf(_SC_PAGESIZE);
+        uint64 start = offset - offset % page;
+        uint64 len = offset + size - start;
+        // private writable mapping, in case anyone modifies the buffer
+        void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fileno(f), start);
+        if (p != MAP_FAILED)
+        {
+            std::shared_ptr<void> owner(p, [len](void *p) {
+                munmap(p, len);
+            });
+            return Buffer((char*)p + (offset - start), size, owner);
+        }
+    }
+#endif
+    Buffer b(size);
+#ifndef _WIN32
+    // pread does not move the file position,
+    //   the file may be shared by multiple threads
+    uint32 done = 0;
+    while (done < size)
+    {
+        ssize_t r = pread(fileno(f), b.data() + done, size - done,
+                          offset + done);
+        if (r <= 0)
+        {
+            LOGTHROW(err1, std::runtime_error)
+                    << "Failed to read cache file";
+        }
+        done += r;
+    }
+#else
+    if (fseek(f, offset, SEEK_SET) != 0
+            || fread(b.data(), size, 1, f) != 1)
+    {
+        LOGTHROW(err1, std::runtime_error) << "Failed to read cache file";
+    }
+#endif
+    return b;
+}
+
+std::string cacheDecodedName(const std::string &name)
+{
+    return name + "#$!decoded" + std::to_string(CacheDecodedVersion);
 }
 
 std::string convertNameToPath(std::string path, bool preserveSlashes)
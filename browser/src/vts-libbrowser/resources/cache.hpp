@@ -29,13 +29,33 @@
 
 #include <string>
 #include <ctime>
+#include <cstdio>
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "../include/vts-browser/buffer.hpp"
+#include "../include/vts-browser/fetcher.hpp"
 
 namespace vts
 {
 
+// validators of a cached entry for conditional requests
+struct CacheValidators
+{
+    std::string etag;
+    std::string lastModified;
+
+    bool empty() const;
+
+    // stored as a single string in the cache entries
+    std::string encode() const;
+    void decode(const std::string &str);
+};
+
 class Cache
 {
 public:
@@ -44,12 +64,85 @@ public:
     virtual bool read(std::string name, Buffer &buffer,
                       sint64 &expires) = 0;
     virtual void write(std::string name, const Buffer &buffer,
-                       sint64 expires) = 0;
+                       sint64 expires, FetchTask::ResourceType type,
+                       const CacheValidators &validators) = 0;
     virtual void purge() = 0;
 
+    // returns validators of the entry, even if it has expired
+    // returns false if there is no such entry or it has no validators
+    virtual bool validators(std::string name,
+                            CacheValidators &validators) = 0;
+
+    // the server confirmed that the entry has not changed
+    // updates the expiration of the entry and reads its content
+    //   (unless the content is null)
+    // returns false if there is no such entry
+    virtual bool revalidate(std::string name, sint64 expires,
+                            Buffer *content) = 0;
+
+    // makes all previous writes durable
+    virtual void sync();
+    virtual void updateStatistics(class MapStatistics &statistics);
+
     static std::shared_ptr<Cache> create(const class MapCreateOptions &options);
 };
 
+// runs the trimming of a size-bounded cache in a background thread
+// the trim function is invoked once at start and after each wake
+class CacheTrimmer
+{
+public:
+    CacheTrimmer(const std::function<void(const CacheTrimmer &)> &trim);
+    ~CacheTrimmer();
+
+    void wake();
+
+    // long running trims should check this periodically
+    bool stopping() const { return stop; }
+
+private:
+    void entry();
+
+    std::function<void(const CacheTrimmer &)> trim;
+    boost::thread thr;
+    boost::mutex mut;
+    boost::condition_variable cond;
+    std::atomic<bool> stop;
+    bool work;
+};
+
+// resources with higher class are kept in the cache for longer
+uint32 cacheEvictionClass(FetchTask::ResourceType type);
+
+// entries of the next class are evicted as if they were accessed
+//   this much later
+static const sint64 CacheEvictionClassSeconds = 24 * 60 * 60;
+
+// trimming reduces the cache to this fraction of its maximum size
+static const double CacheTrimRatio = 0.9;
+
+std::shared_ptr<Cache> createPackCache(const class MapCreateOptions &options);
+std::shared_ptr<Cache> createCacheWriter(const std::shared_ptr<Cache> &backend,
+                                         const class MapCreateOptions &options);
+
+// compresses the data if it is worth it for the resource type
+// returns the uncompressed size, or zero if the data were not compressed
+uint32 cacheCompress(const Buffer &in, Buffer &out,
+                     FetchTask::ResourceType type);
+Buffer cacheDecompress(const Buffer &in, uint32 rawSize);
+
+// name of the entry with the decoded form of a resource
+//   it includes the version of the format of the decoded data
+std::string cacheDecodedName(const std::string &name);
+
+// directory of the cache, including the trailing slash
+std::string cacheRootPath(const class MapCreateOptions &options);
+std::string cacheStripScheme(const std::string &name);
+
+// reads part of an open file
+// large parts are memory mapped (where supported) instead of copied
+Buffer cacheReadFile(FILE *f, uint64 offset, uint32 size);
+
 std::string convertNameToPath(std::string path, bool preserveSlashes);
 std::string convertNameToFolderAndFile(std::string path,
                     std::string &folder, std::string &file);
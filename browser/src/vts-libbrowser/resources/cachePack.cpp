@@ -0,0 +1,1074 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstddef> // offsetof
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/crc.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <dbglog/dbglog.hpp>
+
+#include "../include/vts-browser/options.hpp"
+#include "../include/vts-browser/statistics.hpp"
+
+#include "cache.hpp"
+
+#ifndef _WIN32
+#include <unistd.h> // fsync
+#endif
+
+namespace vts
+{
+
+namespace
+{
+
+static const char Magic[] = "vtspack";
+static const char IndexMagic[] = "vtsidx";
+static const uint16 Version = 4;
+static const uint32 RecordMagic = 0x72737476; // "vtsr"
+
+// a new pack file is started when the last one grows over this size
+static const uint64 MaxPackSize = 256ull * 1024 * 1024;
+
+// compaction is performed when at least half of the store is garbage
+static const uint64 MinCompactionSize = 16ull * 1024 * 1024;
+
+// number of entries evicted while holding the lock
+static const uint32 TrimBatchSize = 256;
+
+struct PackHeader
+{
+    char magic[sizeof(Magic)];
+    uint16 version;
+};
+
+struct RecordHeader
+{
+    uint32 magic;
+    uint32 checksum; // crc32 of the rest of the header, name and data
+    sint64 expires;
+    uint32 nameLen;
+    uint32 dataLen;
+    uint32 resourceType;
+    uint32 rawSize; // zero for uncompressed records
+    uint32 validatorsLen;
+};
+
+// the record is followed by the name, validators and data
+uint32 recordChecksum(const RecordHeader &h, const char *name,
+                      const char *validators, const char *data)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(&h.expires, sizeof(RecordHeader)
+                      - offsetof(RecordHeader, expires));
+    crc.process_bytes(name, h.nameLen);
+    crc.process_bytes(validators, h.validatorsLen);
+    crc.process_bytes(data, h.dataLen);
+    return crc.checksum();
+}
+
+// index file of a pack, written next to it
+//   it lists the live records in the beginning of the pack,
+//   so that only the records appended after it are scanned at startup
+struct IndexHeader
+{
+    char magic[sizeof(IndexMagic)];
+    uint16 version;
+    uint32 count;
+    uint64 size; // length of the pack described by the index
+    uint64 garbage;
+    uint32 checksum; // crc32 of the header (with zero checksum) and entries
+};
+
+struct Entry
+{
+    uint64 offset; // beginning of the record
+    sint64 expires;
+    sint64 access; // time of last read or write
+    uint32 pack;
+    uint32 nameLen;
+    uint32 dataLen; // size of the stored (possibly compressed) data
+    uint32 resourceType;
+    uint32 rawSize;
+    uint32 validatorsLen;
+
+    uint64 recordSize() const
+    {
+        return sizeof(RecordHeader) + nameLen + validatorsLen + dataLen;
+    }
+
+    // entries with lower key are evicted first
+    sint64 evictionKey() const
+    {
+        return access + CacheEvictionClassSeconds * cacheEvictionClass(
+                    (FetchTask::ResourceType)resourceType);
+    }
+};
+
+typedef std::unordered_map<std::string, Entry> Index;
+
+class Pack;
+typedef std::vector<std::shared_ptr<Pack>> Packs;
+
+class Pack
+{
+public:
+    Pack(const std::string &path, bool create) : path(path),
+        indexPath(boost::filesystem::path(path)
+                  .replace_extension(".idx").string()),
+        rf(nullptr), size(sizeof(PackHeader)), garbage(0),
+        dirty(false), indexDirty(true)
+    {
+        if (create)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(indexPath, ec);
+            PackHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, Magic, sizeof(Magic));
+            h.version = Version;
+            std::ofstream o(path, std::ios::binary | std::ios::trunc);
+            o.write((char*)&h, sizeof(h));
+            if (!o)
+            {
+                LOGTHROW(err2, std::runtime_error)
+                        << "Failed to create cache pack <" << path << ">";
+            }
+        }
+        open();
+    }
+
+    ~Pack()
+    {
+        close();
+    }
+
+    // adds the entry into the index, replacing an older record
+    static void insert(Index &index, Packs &packs,
+                       const std::string &name, const Entry &e)
+    {
+        auto it = index.find(name);
+        if (it != index.end())
+        {
+            Pack *p = packs[it->second.pack].get();
+            p->garbage += it->second.recordSize();
+            p->indexDirty = true;
+            it->second = e;
+        }
+        else
+            index.emplace(name, e);
+    }
+
+    // loads the records listed in the index file of the pack
+    // returns false if the index is missing or does not match the pack
+    bool loadIndex(Index &index, uint32 packIndex, Packs &packs)
+    {
+        std::vector<std::pair<std::string, Entry>> entries;
+        IndexHeader h;
+        bool ok = false;
+        {
+            std::ifstream i(indexPath, std::ios::binary);
+            if (!i)
+                return false;
+            i.read((char*)&h, sizeof(h));
+            if (i && memcmp(h.magic, IndexMagic, sizeof(IndexMagic)) == 0
+                    && h.version == Version && h.size >= sizeof(PackHeader)
+                    && h.size <= boost::filesystem::file_size(path))
+            {
+                std::vector<char> buf((std::istreambuf_iterator<char>(i)),
+                                      std::istreambuf_iterator<char>());
+                uint32 checksum = h.checksum;
+                h.checksum = 0;
+                boost::crc_32_type crc;
+                crc.process_bytes(&h, sizeof(h));
+                crc.process_bytes(buf.data(), buf.size());
+                ok = crc.checksum() == checksum;
+                uint64 pos = 0;
+                entries.reserve(h.count);
+                for (uint32 j = 0; ok && j < h.count; j++)
+                {
+                    Entry e;
+                    if (pos + sizeof(e) > buf.size())
+                    {
+                        ok = false;
+                        break;
+                    }
+                    memcpy(&e, buf.data() + pos, sizeof(e));
+                    pos += sizeof(e);
+                    if (pos + e.nameLen > buf.size()
+                            || e.offset + e.recordSize() > h.size)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    e.pack = packIndex;
+                    entries.emplace_back(
+                                std::string(buf.data() + pos, e.nameLen), e);
+                    pos += e.nameLen;
+                }
+                ok = ok && pos == buf.size();
+            }
+        }
+        if (!ok)
+        {
+            LOG(warn2) << "Cache pack index <" << indexPath
+                       << "> is invalid, the pack will be scanned";
+            boost::system::error_code ec;
+            boost::filesystem::remove(indexPath, ec);
+            return false;
+        }
+        for (auto &it : entries)
+            insert(index, packs, it.first, it.second);
+        size = h.size;
+        garbage = h.garbage;
+        indexDirty = false;
+        return true;
+    }
+
+    // writes the index file describing the whole pack
+    // the pack is synced first, the index must not list records
+    //   that could be lost
+    void saveIndex(const std::vector<const Index::value_type*> &entries)
+    {
+        sync();
+        IndexHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, IndexMagic, sizeof(IndexMagic));
+        h.version = Version;
+        h.count = entries.size();
+        h.size = size;
+        h.garbage = garbage;
+        std::string body;
+        for (auto it : entries)
+        {
+            body.append((const char*)&it->second, sizeof(Entry));
+            body.append(it->first);
+        }
+        boost::crc_32_type crc;
+        crc.process_bytes(&h, sizeof(h));
+        crc.process_bytes(body.data(), body.size());
+        h.checksum = crc.checksum();
+        std::string tmp = indexPath + ".tmp";
+        {
+            std::ofstream o(tmp, std::ios::binary | std::ios::trunc);
+            o.write((char*)&h, sizeof(h));
+            o.write(body.data(), body.size());
+            if (!o)
+            {
+                LOGTHROW(err2, std::runtime_error)
+                        << "Failed to write cache pack index <"
+                        << indexPath << ">";
+            }
+        }
+        boost::filesystem::rename(tmp, indexPath);
+        indexDirty = false;
+    }
+
+    // loads all valid records after the part described by the index
+    // the pack is truncated at the first damaged record
+    // the access time of the records is approximated by the pack file time
+    void scan(Index &index, uint32 packIndex, Packs &packs)
+    {
+        sint64 access = boost::filesystem::last_write_time(path);
+        PackHeader ph;
+        f.seekg(0);
+        f.read((char*)&ph, sizeof(ph));
+        if (!f || memcmp(ph.magic, Magic, sizeof(Magic)) != 0
+                || ph.version != Version)
+        {
+            LOGTHROW(err2, std::runtime_error)
+                    << "Invalid cache pack <" << path << ">";
+        }
+        uint64 fileSize = boost::filesystem::file_size(path);
+        std::vector<char> buf;
+        while (true)
+        {
+            if (size == fileSize)
+                return;
+            RecordHeader h;
+            f.seekg(size);
+            f.read((char*)&h, sizeof(h));
+            if (!f || h.magic != RecordMagic
+                    || size + sizeof(h) + h.nameLen + h.validatorsLen
+                        + h.dataLen > fileSize)
+                break;
+            buf.resize(h.nameLen + h.validatorsLen + h.dataLen);
+            f.read(buf.data(), buf.size());
+            if (!f || recordChecksum(h, buf.data(), buf.data() + h.nameLen,
+                        buf.data() + h.nameLen + h.validatorsLen)
+                    != h.checksum)
+                break;
+            Entry e;
+            e.offset = size;
+            e.expires = h.expires;
+            e.access = access;
+            e.pack = packIndex;
+            e.nameLen = h.nameLen;
+            e.dataLen = h.dataLen;
+            e.resourceType = h.resourceType;
+            e.rawSize = h.rawSize;
+            e.validatorsLen = h.validatorsLen;
+            insert(index, packs, std::string(buf.data(), h.nameLen), e);
+            size += e.recordSize();
+            indexDirty = true;
+        }
+        LOG(warn2) << "Cache pack <" << path << "> is damaged at offset "
+                   << size << ", truncating it";
+        close();
+        boost::filesystem::resize_file(path, size);
+        open();
+    }
+
+    uint64 append(const std::string &name, const std::string &validators,
+                  const char *data, const Entry &e)
+    {
+        assert(validators.size() == e.validatorsLen);
+        RecordHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = RecordMagic;
+        h.expires = e.expires;
+        h.nameLen = name.size();
+        h.dataLen = e.dataLen;
+        h.resourceType = e.resourceType;
+        h.rawSize = e.rawSize;
+        h.validatorsLen = e.validatorsLen;
+        h.checksum = recordChecksum(h, name.data(), validators.data(), data);
+        f.clear();
+        f.seekp(size);
+        f.write((char*)&h, sizeof(h));
+        f.write(name.data(), name.size());
+        f.write(validators.data(), validators.size());
+        f.write(data, e.dataLen);
+        if (!f)
+        {
+            f.clear();
+            LOGTHROW(err2, std::runtime_error)
+                    << "Failed to write into cache pack <" << path << ">";
+        }
+        uint64 offset = size;
+        size += e.recordSize();
+        dirty = true;
+        return offset;
+    }
+
+    void flush()
+    {
+        if (!dirty)
+            return;
+        f.flush();
+        dirty = false;
+    }
+
+    void sync()
+    {
+        flush();
+#ifndef _WIN32
+        fsync(fileno(rf));
+#endif
+    }
+
+    // records are never modified once written,
+    //   they may be read without the lock of the cache
+    //   once the pack was flushed
+    Buffer read(const Entry &e)
+    {
+#ifdef _WIN32
+        boost::lock_guard<boost::mutex> l(mutRead); // no pread
+#endif
+        return cacheReadFile(rf, e.offset + sizeof(RecordHeader) + e.nameLen
+                             + e.validatorsLen, e.dataLen);
+    }
+
+    std::string readValidators(const Entry &e)
+    {
+        if (e.validatorsLen == 0)
+            return "";
+#ifdef _WIN32
+        boost::lock_guard<boost::mutex> l(mutRead);
+#endif
+        Buffer b = cacheReadFile(rf, e.offset + sizeof(RecordHeader)
+                                 + e.nameLen, e.validatorsLen);
+        return b.str();
+    }
+
+    const std::string path;
+    const std::string indexPath;
+    std::fstream f; // used for writing
+    FILE *rf; // used for reading
+#ifdef _WIN32
+    boost::mutex mutRead;
+#endif
+    uint64 size;
+    uint64 garbage;
+    bool dirty;
+    bool indexDirty; // the index file does not match the pack
+
+private:
+    void open()
+    {
+        f.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        rf = fopen(path.c_str(), "rb");
+        if (!f || !rf)
+        {
+            close();
+            LOGTHROW(err2, std::runtime_error)
+                    << "Failed to open cache pack <" << path << ">";
+        }
+    }
+
+    void close()
+    {
+        f.close();
+        if (rf)
+            fclose(rf);
+        rf = nullptr;
+    }
+};
+
+class PackCacheImpl : public Cache
+{
+public:
+    PackCacheImpl(const MapCreateOptions &options) :
+        compression(options.cacheCompression),
+        maxSize((uint64)options.cacheMaxSizeMB * 1024 * 1024),
+        diskUse(0), evicted(0), hits(0), misses(0), generation(0)
+    {
+        root = cacheRootPath(options) + "pack";
+        LOG(info2) << "Disk cache packs path: <" << root << ">";
+        try
+        {
+            load(true);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn3) << "Failed to load the cache packs: <"
+                       << e.what() << ">, starting with empty cache";
+            reset();
+        }
+        if (maxSize > 0)
+            trimmer.reset(new CacheTrimmer(
+                [this](const CacheTrimmer &t) { trim(t); }));
+    }
+
+    ~PackCacheImpl()
+    {
+        trimmer.reset();
+        boost::lock_guard<boost::mutex> l(mut);
+        saveIndices();
+    }
+
+    void write(std::string name, const Buffer &buffer, sint64 expires,
+               FetchTask::ResourceType type,
+               const CacheValidators &validators) override
+    {
+        name = cacheStripScheme(name);
+        try
+        {
+            // compressed before taking the lock
+            Buffer compressed;
+            Entry e;
+            e.rawSize = compression ? cacheCompress(buffer, compressed, type)
+                                    : 0;
+            const Buffer &payload = e.rawSize ? compressed : buffer;
+            e.expires = expires;
+            e.nameLen = name.size();
+            e.dataLen = payload.size();
+            e.resourceType = (uint32)type;
+            std::string v = validators.encode();
+            e.validatorsLen = v.size();
+            boost::lock_guard<boost::mutex> l(mut);
+            if (packs.empty())
+                return;
+            e.access = std::time(nullptr);
+            appendEntry(name, v, payload, e);
+            if (trimmer && (diskUse += e.recordSize()) > maxSize)
+                trimmer->wake();
+        }
+        catch (...)
+        {
+            // do nothing
+        }
+    }
+
+    bool read(std::string name,
+              Buffer &buffer, sint64 &expires) override
+    {
+        assert(buffer.size() == 0);
+        name = cacheStripScheme(name);
+        Entry e;
+        std::shared_ptr<Pack> pack;
+        {
+            // only the lookup is done under the lock
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = index.find(name);
+            if (it == index.end())
+            {
+                misses++;
+                return false;
+            }
+            expires = it->second.expires;
+            if (expires == -2 // must revalidate
+                    || (expires > 0 && expires < std::time(nullptr)))
+            {
+                misses++;
+                return false;
+            }
+            it->second.access = std::time(nullptr);
+            e = it->second;
+            pack = packs[e.pack];
+            pack->flush();
+        }
+        try
+        {
+            if (e.dataLen > 0)
+                buffer = pack->read(e);
+            if (e.rawSize > 0)
+                buffer = cacheDecompress(buffer, e.rawSize);
+            hits++;
+            return true;
+        }
+        catch (...)
+        {
+            buffer = Buffer();
+            misses++;
+            return false;
+        }
+    }
+
+    bool validators(std::string name,
+                    CacheValidators &validators) override
+    {
+        name = cacheStripScheme(name);
+        Entry e;
+        std::shared_ptr<Pack> pack;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = index.find(name);
+            if (it == index.end() || it->second.validatorsLen == 0)
+                return false;
+            e = it->second;
+            pack = packs[e.pack];
+            pack->flush();
+        }
+        try
+        {
+            validators.decode(pack->readValidators(e));
+            return !validators.empty();
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    bool revalidate(std::string name, sint64 expires,
+                    Buffer *content) override
+    {
+        name = cacheStripScheme(name);
+        Entry e;
+        std::shared_ptr<Pack> pack;
+        uint32 gen = 0;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = index.find(name);
+            if (it == index.end())
+                return false;
+            e = it->second;
+            pack = packs[e.pack];
+            pack->flush();
+            gen = generation;
+        }
+        try
+        {
+            // the record is appended again with the new expiration
+            Buffer buf;
+            if (e.dataLen > 0)
+                buf = pack->read(e);
+            std::string v = pack->readValidators(e);
+            {
+                boost::lock_guard<boost::mutex> l(mut);
+                auto it = index.find(name);
+                // replaced or evicted meanwhile
+                if (gen != generation || it == index.end()
+                        || it->second.pack != e.pack
+                        || it->second.offset != e.offset)
+                    return false;
+                e.expires = expires;
+                e.access = std::time(nullptr);
+                appendEntry(name, v, buf, e);
+                if (trimmer && (diskUse += e.recordSize()) > maxSize)
+                    trimmer->wake();
+            }
+            if (content)
+            {
+                if (e.rawSize > 0)
+                    *content = cacheDecompress(buf, e.rawSize);
+                else
+                    *content = std::move(buf);
+            }
+            return true;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    void sync() override
+    {
+        boost::lock_guard<boost::mutex> l(mut);
+        if (!packs.empty())
+            packs.back()->sync();
+    }
+
+    void purge() override
+    {
+        LOG(info2) << "Purging disk cache packs";
+        boost::lock_guard<boost::mutex> l(mut);
+        try
+        {
+            packs.clear();
+            index.clear();
+            boost::filesystem::remove_all(root);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn3) << "Purging cache failed: <" << e.what() << ">";
+        }
+        reset();
+    }
+
+    void updateStatistics(MapStatistics &statistics) override
+    {
+        statistics.cacheDiskUseMB = diskUse / 1024 / 1024;
+        statistics.cacheEntriesEvicted = evicted;
+        statistics.cacheLookupHits = hits;
+        statistics.cacheLookupMisses = misses;
+        statistics.cacheLookupFalsePositives = 0; // the index is exact
+    }
+
+private:
+    static std::string packPath(const std::string &dir, uint32 index)
+    {
+        return dir + "/" + std::to_string(index) + ".pack";
+    }
+
+    static void addPack(Packs &packs, const std::string &dir)
+    {
+        packs.push_back(std::make_shared<Pack>(
+                            packPath(dir, packs.size()), true));
+    }
+
+    // opens all pack files in the directory
+    // packs removed by trimming are left as empty slots
+    static void openPacks(Packs &packs, const std::string &dir)
+    {
+        uint32 count = 0;
+        for (boost::filesystem::directory_iterator it(dir), e; it != e; it++)
+        {
+            if (it->path().extension() != ".pack")
+                continue;
+            try
+            {
+                count = std::max<uint32>(count,
+                            std::stoul(it->path().stem().string()) + 1);
+            }
+            catch (...)
+            {
+                // ignore unrelated files
+            }
+        }
+        for (uint32 i = 0; i < count; i++)
+        {
+            if (boost::filesystem::exists(packPath(dir, i)))
+                packs.push_back(std::make_shared<Pack>(
+                                    packPath(dir, i), false));
+            else
+                packs.push_back(nullptr);
+        }
+    }
+
+    // appends the record into the last pack and updates the index
+    // all but pack and offset must be set in the entry
+    void appendEntry(const std::string &name, const std::string &validators,
+                     const Buffer &buffer, Entry &e)
+    {
+        if (packs.back()->size > MaxPackSize)
+        {
+            saveIndices(); // includes the full pack
+            addPack(packs, root);
+        }
+        e.pack = packs.size() - 1;
+        e.offset = packs.back()->append(name, validators, buffer.data(), e);
+        packs.back()->indexDirty = true;
+        Pack::insert(index, packs, name, e);
+    }
+
+    // writes the index files of the packs that changed
+    void saveIndices()
+    {
+        std::vector<std::vector<const Index::value_type*>> entries;
+        entries.resize(packs.size());
+        for (auto &it : index)
+            if (packs[it.second.pack]->indexDirty)
+                entries[it.second.pack].push_back(&it);
+        for (uint32 i = 0; i < packs.size(); i++)
+        {
+            if (!packs[i] || !packs[i]->indexDirty)
+                continue;
+            try
+            {
+                packs[i]->saveIndex(entries[i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG(warn2) << "Failed to save cache pack index: <"
+                           << e.what() << ">";
+            }
+        }
+    }
+
+    void load(bool allowCompaction)
+    {
+        // finish interrupted compaction
+        std::string compacted = root + "-compact";
+        std::string old = root + "-old";
+        if (!boost::filesystem::exists(root)
+                && boost::filesystem::exists(compacted))
+            boost::filesystem::rename(compacted, root);
+        boost::filesystem::remove_all(compacted);
+        boost::filesystem::remove_all(old);
+
+        boost::filesystem::create_directories(root);
+        openPacks(packs, root);
+        for (uint32 i = 0; i < packs.size(); i++)
+        {
+            if (!packs[i])
+                continue;
+            packs[i]->loadIndex(index, i, packs);
+            packs[i]->scan(index, i, packs);
+        }
+        if (packs.empty())
+            addPack(packs, root);
+
+        uint64 total = 0, garbage = 0;
+        for (auto &it : packs)
+        {
+            if (!it)
+                continue;
+            total += it->size;
+            garbage += it->garbage;
+        }
+        diskUse = total;
+        LOG(info2) << "Disk cache packs contain " << index.size()
+                   << " entries in " << packs.size() << " files, "
+                   << (garbage / 1024) << " of " << (total / 1024)
+                   << " KB is garbage";
+        if (allowCompaction && total > MinCompactionSize
+                && garbage * 2 > total)
+            compact();
+    }
+
+    // rewrites all live records into new packs
+    void compact()
+    {
+        LOG(info2) << "Compacting disk cache packs";
+        std::string compacted = root + "-compact";
+        std::string old = root + "-old";
+        try
+        {
+            // copy the records in the order they are stored
+            std::vector<Index::value_type*> entries;
+            entries.reserve(index.size());
+            for (auto &it : index)
+                entries.push_back(&it);
+            std::sort(entries.begin(), entries.end(), [](
+                      const Index::value_type *a,
+                      const Index::value_type *b) {
+                if (a->second.pack != b->second.pack)
+                    return a->second.pack < b->second.pack;
+                return a->second.offset < b->second.offset;
+            });
+
+            boost::filesystem::remove_all(compacted);
+            boost::filesystem::create_directories(compacted);
+            Packs np;
+            addPack(np, compacted);
+            Index ni;
+            for (auto it : entries)
+            {
+                const Entry &e = it->second;
+                Buffer buf;
+                if (e.dataLen > 0)
+                    buf = packs[e.pack]->read(e);
+                std::string v = packs[e.pack]->readValidators(e);
+                if (np.back()->size > MaxPackSize)
+                    addPack(np, compacted);
+                Entry n(e);
+                n.pack = np.size() - 1;
+                n.offset = np.back()->append(it->first, v, buf.data(), e);
+                ni.emplace(it->first, n);
+            }
+
+            // swap the directories
+            for (auto &it : np)
+                it->sync();
+            np.clear();
+            packs.clear();
+            boost::filesystem::rename(root, old);
+            boost::filesystem::rename(compacted, root);
+            boost::filesystem::remove_all(old);
+            openPacks(packs, root);
+            uint64 total = 0;
+            for (auto &it : packs)
+            {
+                it->size = boost::filesystem::file_size(it->path);
+                total += it->size;
+            }
+            diskUse = total;
+            index.swap(ni);
+            saveIndices();
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn3) << "Compacting disk cache packs failed: <"
+                       << e.what() << ">";
+            packs.clear();
+            index.clear();
+            load(false);
+        }
+    }
+
+    // evicts the least recently used entries
+    //   and reclaims the space by moving the remaining entries
+    //   out of the packs that are mostly garbage
+    // the index is only snapshotted under the lock,
+    //   sorting is done outside and the eviction in small batches
+    void trim(const CacheTrimmer &t)
+    {
+        struct Victim
+        {
+            std::string name;
+            sint64 key;
+            sint64 access;
+            uint64 offset;
+            uint32 pack;
+        };
+        std::vector<Victim> entries;
+        uint64 live = 0;
+        uint32 gen = 0;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            gen = generation;
+            uint64 total = 0;
+            for (auto &it : packs)
+                if (it)
+                    total += it->size;
+            diskUse = total;
+            if (total <= maxSize || packs.empty())
+                return;
+            entries.reserve(index.size());
+            for (auto &it : index)
+            {
+                const Entry &e = it.second;
+                live += e.recordSize();
+                entries.push_back({ it.first, e.evictionKey(), e.access,
+                                    e.offset, e.pack });
+            }
+        }
+        uint64 target = maxSize * CacheTrimRatio;
+
+        if (live > target)
+        {
+            std::sort(entries.begin(), entries.end(), [](
+                      const Victim &a, const Victim &b) {
+                return a.key < b.key;
+            });
+            uint32 cnt = 0;
+            auto it = entries.begin();
+            while (it != entries.end() && live > target)
+            {
+                if (t.stopping())
+                    return;
+                boost::lock_guard<boost::mutex> l(mut);
+                if (gen != generation)
+                    return;
+                for (uint32 i = 0; i < TrimBatchSize
+                     && it != entries.end() && live > target; i++, it++)
+                {
+                    auto e = index.find(it->name);
+                    // skip entries rewritten or read since the snapshot
+                    if (e == index.end() || e->second.pack != it->pack
+                            || e->second.offset != it->offset
+                            || e->second.access != it->access)
+                        continue;
+                    uint64 s = e->second.recordSize();
+                    packs[e->second.pack]->garbage += s;
+                    packs[e->second.pack]->indexDirty = true;
+                    live -= s;
+                    index.erase(e);
+                    cnt++;
+                }
+            }
+            evicted += cnt;
+            LOG(info2) << "Evicted " << cnt
+                       << " entries from the disk cache packs";
+        }
+        std::vector<Victim>().swap(entries);
+
+        std::vector<uint32> evacuate;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            if (gen != generation)
+                return;
+            uint64 total = 0;
+            for (auto &it : packs)
+                if (it)
+                    total += it->size;
+
+            // choose the packs with most garbage
+            std::vector<uint32> candidates;
+            for (uint32 i = 0; i < packs.size(); i++)
+                if (packs[i] && packs[i]->garbage > 0)
+                    candidates.push_back(i);
+            std::sort(candidates.begin(), candidates.end(),
+                      [&](uint32 a, uint32 b) {
+                return packs[a]->garbage * packs[b]->size
+                        > packs[b]->garbage * packs[a]->size;
+            });
+            for (uint32 i : candidates)
+            {
+                if (total <= target)
+                    break;
+                evacuate.push_back(i);
+                total -= packs[i]->garbage;
+            }
+
+            // the last pack is never evacuated, start a new one
+            if (std::find(evacuate.begin(), evacuate.end(),
+                          packs.size() - 1) != evacuate.end())
+            {
+                packs.back()->sync();
+                addPack(packs, root);
+            }
+        }
+        for (uint32 pi : evacuate)
+            evacuatePack(t, pi, gen);
+    }
+
+    // moves all entries from the pack into the last pack
+    //   and removes the pack file
+    // the lock is held for one entry at a time
+    void evacuatePack(const CacheTrimmer &t, uint32 pi, uint32 gen)
+    {
+        std::vector<std::string> names;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            if (gen != generation)
+                return;
+            for (auto &it : index)
+                if (it.second.pack == pi)
+                    names.push_back(it.first);
+        }
+        for (const std::string &name : names)
+        {
+            if (t.stopping())
+                return;
+            boost::lock_guard<boost::mutex> l(mut);
+            if (gen != generation)
+                return;
+            auto it = index.find(name);
+            if (it == index.end() || it->second.pack != pi)
+                continue;
+            Entry e = it->second;
+            Buffer buf;
+            packs[pi]->flush();
+            if (e.dataLen > 0)
+                buf = packs[pi]->read(e);
+            appendEntry(name, packs[pi]->readValidators(e), buf, e);
+        }
+        boost::lock_guard<boost::mutex> l(mut);
+        if (gen != generation)
+            return;
+        // the copies must be durable before the originals are removed
+        packs.back()->sync();
+        std::string path = packs[pi]->path;
+        std::string indexPath = packs[pi]->indexPath;
+        diskUse -= packs[pi]->size;
+        packs[pi].reset();
+        boost::system::error_code ec;
+        boost::filesystem::remove(indexPath, ec);
+        // readers may still have the file open
+        boost::filesystem::remove(path, ec);
+    }
+
+    // start with empty cache
+    void reset()
+    {
+        packs.clear();
+        index.clear();
+        generation++;
+        diskUse = 0;
+        try
+        {
+            boost::filesystem::remove_all(root);
+            boost::filesystem::create_directories(root);
+            addPack(packs, root);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(warn3) << "Failed to initialize the cache packs: <"
+                       << e.what() << ">, the cache is disabled";
+            packs.clear();
+        }
+    }
+
+    std::string root;
+    Packs packs;
+    Index index;
+    boost::mutex mut;
+    const bool compression;
+    const uint64 maxSize;
+    std::atomic<uint64> diskUse;
+    std::atomic<uint32> evicted;
+    std::atomic<uint32> hits;
+    std::atomic<uint32> misses;
+    uint32 generation; // incremented by reset
+    std::unique_ptr<CacheTrimmer> trimmer;
+};
+
+} // namespace
+
+std::shared_ptr<Cache> createPackCache(const MapCreateOptions &options)
+{
+    return std::make_shared<PackCacheImpl>(options);
+}
+
+} // namespace vts
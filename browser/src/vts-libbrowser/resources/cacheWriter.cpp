@@ -0,0 +1,297 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <dbglog/dbglog.hpp>
+
+#include "../include/vts-browser/options.hpp"
+#include "../include/vts-browser/statistics.hpp"
+#include "../include/vts-browser/log.hpp"
+
+#include "cache.hpp"
+
+namespace vts
+{
+
+namespace
+{
+
+// maximum number of entries written before the backend is synced
+static const uint32 BatchSize = 50;
+
+// how long a write may wait for space in a full queue before it is dropped
+static const uint32 FullQueueWaitMs = 10;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Item
+{
+    std::string name;
+    Buffer buffer;
+    sint64 expires;
+    FetchTask::ResourceType type;
+    CacheValidators validators;
+    Clock::time_point queued;
+};
+
+// queues the writes and performs them in a background thread
+class CacheWriterImpl : public Cache
+{
+public:
+    CacheWriterImpl(const std::shared_ptr<Cache> &backend,
+                    const MapCreateOptions &options) :
+        backend(backend),
+        maxMemory((uint64)options.cacheWriteQueueKB * 1024),
+        dropOnFull(options.cacheWriteQueueDropOnFull),
+        memory(0), latency(0), dropped(0), pendingHits(0), generation(0),
+        stop(false)
+    {
+        thr = boost::thread(&CacheWriterImpl::entry, this);
+    }
+
+    ~CacheWriterImpl()
+    {
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            stop = true;
+            condWork.notify_all();
+        }
+        thr.join();
+    }
+
+    void write(std::string name, const Buffer &buffer, sint64 expires,
+               FetchTask::ResourceType type,
+               const CacheValidators &validators) override
+    {
+        name = cacheStripScheme(name);
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->name = name;
+        // downloaded content is shared, not copied
+        item->buffer = buffer.share();
+        item->expires = expires;
+        item->type = type;
+        item->validators = validators;
+        boost::unique_lock<boost::mutex> l(mut);
+        // the writes come from the fetcher threads,
+        //   they should not be blocked for long
+        auto deadline = boost::chrono::steady_clock::now()
+                + boost::chrono::milliseconds(FullQueueWaitMs);
+        while (!queue.empty() && memory + buffer.size() > maxMemory)
+        {
+            if (!dropOnFull)
+                condSpace.wait(l); // backpressure
+            else if (condSpace.wait_until(l, deadline)
+                     == boost::cv_status::timeout
+                     && !queue.empty()
+                     && memory + buffer.size() > maxMemory)
+            {
+                dropped++;
+                return;
+            }
+        }
+        item->queued = Clock::now();
+        memory += item->buffer.size();
+        pending[name] = item;
+        queue.push_back(item);
+        condWork.notify_one();
+    }
+
+    bool read(std::string name,
+              Buffer &buffer, sint64 &expires) override
+    {
+        name = cacheStripScheme(name);
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = pending.find(name);
+            if (it != pending.end())
+            {
+                const Item &i = *it->second;
+                expires = i.expires;
+                if (expires == -2)
+                    return false; // must revalidate
+                if (expires > 0 && expires < std::time(nullptr))
+                    return false;
+                buffer = i.buffer.share();
+                pendingHits++;
+                return true;
+            }
+        }
+        return backend->read(name, buffer, expires);
+    }
+
+    bool validators(std::string name,
+                    CacheValidators &validators) override
+    {
+        name = cacheStripScheme(name);
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = pending.find(name);
+            if (it != pending.end())
+            {
+                validators = it->second->validators;
+                return !validators.empty();
+            }
+        }
+        return backend->validators(name, validators);
+    }
+
+    bool revalidate(std::string name, sint64 expires,
+                    Buffer *content) override
+    {
+        name = cacheStripScheme(name);
+        std::shared_ptr<Item> item;
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            auto it = pending.find(name);
+            if (it != pending.end())
+                item = it->second;
+        }
+        if (!item)
+            return backend->revalidate(name, expires, content);
+        // queued items are never modified, queue a new one instead
+        if (content)
+            *content = item->buffer.share();
+        write(name, item->buffer, expires, item->type, item->validators);
+        return true;
+    }
+
+    void purge() override
+    {
+        {
+            boost::lock_guard<boost::mutex> l(mut);
+            queue.clear();
+            pending.clear();
+            memory = 0;
+            generation++;
+            condSpace.notify_all();
+        }
+        // wait for the batch in progress
+        boost::lock_guard<boost::mutex> l(mutBackend);
+        backend->purge();
+    }
+
+    void sync() override
+    {
+        boost::unique_lock<boost::mutex> l(mut);
+        while (!pending.empty())
+            condSpace.wait(l);
+    }
+
+    void updateStatistics(MapStatistics &statistics) override
+    {
+        backend->updateStatistics(statistics);
+        boost::lock_guard<boost::mutex> l(mut);
+        statistics.cacheWriteQueueDepth = queue.size();
+        statistics.cacheWriteLatencyMicroseconds = latency;
+        statistics.cacheWritesDropped = dropped;
+        statistics.cacheLookupHits += pendingHits;
+    }
+
+private:
+    void entry()
+    {
+        setLogThreadName("cache writer");
+        std::vector<std::shared_ptr<Item>> batch;
+        uint32 batchGeneration = 0;
+        while (true)
+        {
+            {
+                boost::unique_lock<boost::mutex> l(mut);
+                while (!stop && queue.empty())
+                    condWork.wait(l);
+                if (queue.empty())
+                    return; // stop after all pending writes are done
+                while (!queue.empty() && batch.size() < BatchSize)
+                {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+                batchGeneration = generation;
+            }
+            {
+                boost::lock_guard<boost::mutex> l(mutBackend);
+                for (auto &it : batch)
+                    backend->write(it->name, it->buffer, it->expires,
+                                   it->type, it->validators);
+                // one sync for the whole batch
+                //   (the per-file cache does not sync at all)
+                backend->sync();
+            }
+            {
+                boost::lock_guard<boost::mutex> l(mut);
+                if (batchGeneration == generation)
+                {
+                    for (auto &it : batch)
+                    {
+                        memory -= it->buffer.size();
+                        auto p = pending.find(it->name);
+                        if (p != pending.end() && p->second == it)
+                            pending.erase(p);
+                    }
+                }
+                // time from queuing the oldest entry until it was written
+                latency = std::chrono::duration_cast<
+                        std::chrono::microseconds>(
+                            Clock::now() - batch.front()->queued).count();
+                condSpace.notify_all();
+            }
+            batch.clear();
+        }
+    }
+
+    std::shared_ptr<Cache> backend;
+    std::deque<std::shared_ptr<Item>> queue;
+    std::unordered_map<std::string, std::shared_ptr<Item>> pending;
+    boost::thread thr;
+    boost::mutex mut;
+    boost::mutex mutBackend;
+    boost::condition_variable condWork;
+    boost::condition_variable condSpace;
+    const uint64 maxMemory;
+    const bool dropOnFull;
+    uint64 memory;
+    uint32 latency;
+    uint32 dropped;
+    uint32 pendingHits; // reads served from the queue
+    uint32 generation; // incremented by purge
+    bool stop;
+};
+
+} // namespace
+
+std::shared_ptr<Cache> createCacheWriter(const std::shared_ptr<Cache> &backend,
+                                         const MapCreateOptions &options)
+{
+    return std::make_shared<CacheWriterImpl>(backend, options);
+}
+
+} // namespace vts
@@ -38,7 +38,10 @@ FetcherOptions::FetcherOptions()
       maxHostConnections(0),
       maxTotalConnections(10),
       maxCacheConections(0),
-      pipelining(2)
+      pipelining(2),
+      adaptiveConcurrency(false),
+      maxActiveTransfers(0),
+      replayLatencyScale(1)
 {}
 
 FetcherOptions::FetcherOptions(const std::string &json)
@@ -59,6 +62,21 @@ std::string FetcherOptions::toJson() const
 Fetcher::~Fetcher()
 {}
 
+bool Fetcher::cancel(const std::shared_ptr<FetchTask> &)
+{
+    return false;
+}
+
+void Fetcher::hostStatistics(std::vector<FetcherHostStatistics> &hosts)
+{
+    hosts.clear();
+}
+
+FetcherHostStatistics::FetcherHostStatistics() :
+    concurrencyLimit(0), active(0), queued(0), latencyMilliseconds(0),
+    throughputKBps(0), succeeded(0), failed(0)
+{}
+
 FetchTask::Query::Query(const std::string &url,
                         FetchTask::ResourceType resourceType) :
     url(url), resourceType(resourceType)
@@ -67,11 +85,11 @@ FetchTask::Query::Query(const std::string &url,
 FetchTask::Reply::Reply() : expires(-1), code(0)
 {}
 
-FetchTask::FetchTask(const Query &query) : query(query)
+FetchTask::FetchTask(const Query &query) : query(query), fetchPriority(0)
 {}
 
 FetchTask::FetchTask(const std::string &url, ResourceType resourceType) :
-    query(url, resourceType)
+    query(url, resourceType), fetchPriority(0)
 {}
 
 FetchTask::~FetchTask()
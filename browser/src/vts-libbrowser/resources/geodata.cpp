@@ -701,6 +701,7 @@ void GpuGeodata::update(const std::string &s, const std::string &f, uint32 l)
             features = f;
             lod = l;
             state = Resource::State::downloaded;
+            map->resources.stateEpoch++;
         }
         break;
     default:
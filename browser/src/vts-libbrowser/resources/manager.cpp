@@ -24,7 +24,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <chrono>
+#include <boost/lexical_cast.hpp>
+
 #include "../include/vts-browser/map.hpp"
+#include "../include/vts-browser/log.hpp"
 #include "../map.hpp"
 
 namespace vts
@@ -41,7 +45,7 @@ std::shared_ptr<T> getMapResource(MapImpl *map, const std::string &name)
     if (it == map->resources.resources.end())
     {
         auto r = std::make_shared<T>(map, name);
-        map->resources.resources[name] = r;
+        map->resourceInsert(r);
         it = map->resources.resources.find(name);
         map->statistics.resourcesCreated++;
     }
@@ -52,6 +56,37 @@ std::shared_ptr<T> getMapResource(MapImpl *map, const std::string &name)
     return res;
 }
 
+template<class T>
+std::shared_ptr<T> getMapResource(MapImpl *map, const ResourceKey &key,
+        const UrlTemplate &url, const UrlTemplate::Vars &vars)
+{
+    auto &keys = map->resources.resourcesByKey;
+    auto it = keys.find(key);
+    if (it != keys.end())
+    {
+        std::shared_ptr<Resource> r = it->second.lock();
+        if (r)
+        {
+            map->touchResource(r);
+            return std::static_pointer_cast<T>(r);
+        }
+        keys.erase(it);
+    }
+    // the url is expanded only the first time the key is seen
+    std::shared_ptr<T> res = getMapResource<T>(map, url(vars));
+    keys.emplace(key, res);
+    res->keys.push_back(key);
+    return res;
+}
+
+// splitmix64 finalizer
+uint64 mixBits(uint64 x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
 void initializeFetchTask(MapImpl *map, const std::shared_ptr<Resource> &task)
 {
     LOG(debug) << "Resource <" << task->name << "> initializing fetch";
@@ -62,6 +97,20 @@ void initializeFetchTask(MapImpl *map, const std::shared_ptr<Resource> &task)
         task->query.url = task->name;
 }
 
+// expired cached content is revalidated instead of downloaded again
+void setConditionalHeaders(MapImpl *map, const std::shared_ptr<Resource> &r)
+{
+    r->query.headers.erase("If-None-Match");
+    r->query.headers.erase("If-Modified-Since");
+    CacheValidators v;
+    if (!map->resources.cache->validators(r->name, v))
+        return;
+    if (!v.etag.empty())
+        r->query.headers["If-None-Match"] = v.etag;
+    if (!v.lastModified.empty())
+        r->query.headers["If-Modified-Since"] = v.lastModified;
+}
+
 bool allowDiskCache(Resource::ResourceType type)
 {
     switch (type)
@@ -76,24 +125,275 @@ bool allowDiskCache(Resource::ResourceType type)
     }
 }
 
+bool allowDecodeThreads(Resource::ResourceType type)
+{
+    switch (type)
+    {
+    case Resource::ResourceType::BoundMetaTile:
+    case Resource::ResourceType::MetaTile:
+    case Resource::ResourceType::Mesh:
+    case Resource::ResourceType::Texture:
+    case Resource::ResourceType::NavTile:
+        return true;
+    default:
+        return false;
+    }
+}
+
 bool startsWith(const std::string &text, const std::string &start)
 {
     return text.substr(0, start.length()) == start;
 }
 
-void releaseIfLast(std::shared_ptr<Resource> &p)
+void listLink(Resource *&first, Resource *&last, Resource *r)
+{
+    r->lruPrev = last;
+    r->lruNext = nullptr;
+    if (last)
+        last->lruNext = r;
+    else
+        first = r;
+    last = r;
+}
+
+void listUnlink(Resource *&first, Resource *&last, Resource *r)
+{
+    if (r->lruPrev)
+        r->lruPrev->lruNext = r->lruNext;
+    else
+        first = r->lruNext;
+    if (r->lruNext)
+        r->lruNext->lruPrev = r->lruPrev;
+    else
+        last = r->lruPrev;
+    r->lruPrev = r->lruNext = nullptr;
+}
+
+// the resource is in either the lru list or the parked list
+bool lruLinked(const MapImpl::Resources &res, const Resource *r)
+{
+    return r->lruPrev || res.lruFirst == r || res.parkedFirst == r;
+}
+
+void lruLink(MapImpl::Resources &res, Resource *r)
+{
+    assert(!lruLinked(res, r));
+    listLink(res.lruFirst, res.lruLast, r);
+}
+
+void lruUnlink(MapImpl::Resources &res, Resource *r)
+{
+    assert(lruLinked(res, r));
+    if (r->lruParked)
+        listUnlink(res.parkedFirst, res.parkedLast, r);
+    else
+        listUnlink(res.lruFirst, res.lruLast, r);
+    r->lruParked = false;
+}
+
+// moves the resource to the end of the parked list
+//   the lru list keeps only resources ordered by their last access
+void lruPark(MapImpl::Resources &res, Resource *r)
+{
+    lruUnlink(res, r);
+    listLink(res.parkedFirst, res.parkedLast, r);
+    r->lruParked = true;
+}
+
+// resources in these states will not change without being touched again
+bool stateSettled(Resource::State s)
+{
+    switch (s)
+    {
+    case Resource::State::ready:
+    case Resource::State::errorFatal:
+    case Resource::State::availFail:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// wakes up the data thread when leaving the scope
+class DataWorkNotifier
+{
+public:
+    DataWorkNotifier(MapImpl *map) : map(map)
+    {}
+
+    ~DataWorkNotifier()
+    {
+        map->resourceDataNotify();
+    }
+
+private:
+    MapImpl *const map;
+};
+
+const uint32 InvalidQueueIndex = (uint32)-1;
+
+// number of parked resources checked for release in one render tick
+const uint32 ParkedChecksPerTick = 50;
+
+typedef std::vector<std::shared_ptr<Resource>> DataQueue;
+
+void dataQueueSwap(DataQueue &q, uint32 a, uint32 b)
+{
+    std::swap(q[a], q[b]);
+    q[a]->dataQueueIndex = a;
+    q[b]->dataQueueIndex = b;
+}
+
+void dataQueueSiftUp(DataQueue &q, uint32 i)
+{
+    while (i > 0)
+    {
+        uint32 p = (i - 1) / 2;
+        if (q[p]->priorityCopy >= q[i]->priorityCopy)
+            break;
+        dataQueueSwap(q, p, i);
+        i = p;
+    }
+}
+
+void dataQueueSiftDown(DataQueue &q, uint32 i)
 {
-    std::weak_ptr<Resource> w = p;
-    p.reset();
-    p = w.lock();
+    uint32 s = q.size();
+    while (true)
+    {
+        uint32 l = i * 2 + 1;
+        uint32 r = l + 1;
+        uint32 m = i;
+        if (l < s && q[l]->priorityCopy > q[m]->priorityCopy)
+            m = l;
+        if (r < s && q[r]->priorityCopy > q[m]->priorityCopy)
+            m = r;
+        if (m == i)
+            break;
+        dataQueueSwap(q, m, i);
+        i = m;
+    }
+}
+
+// inserts the resource or updates its position after priority change
+void dataQueueUpdate(DataQueue &q, const std::shared_ptr<Resource> &r)
+{
+    if (r->dataQueueIndex == InvalidQueueIndex)
+    {
+        r->dataQueueIndex = q.size();
+        q.push_back(r);
+    }
+    assert(q[r->dataQueueIndex] == r);
+    dataQueueSiftUp(q, r->dataQueueIndex);
+    dataQueueSiftDown(q, r->dataQueueIndex);
+}
+
+std::shared_ptr<Resource> dataQueuePop(DataQueue &q)
+{
+    assert(!q.empty());
+    dataQueueSwap(q, 0, q.size() - 1);
+    std::shared_ptr<Resource> r = std::move(q.back());
+    q.pop_back();
+    r->dataQueueIndex = InvalidQueueIndex;
+    if (!q.empty())
+        dataQueueSiftDown(q, 0);
+    return r;
 }
 
+// limits the work done in single dataTick
+//   either by count of processed resources or by time
+class DataTickBudget
+{
+public:
+    DataTickBudget(const MapOptions &options) : options(options),
+        start(std::chrono::steady_clock::now()), processed(0),
+        finished(false)
+    {}
+
+    // returns false when no more resources may be processed in this tick
+    bool next()
+    {
+        if (finished)
+            return false;
+        if (options.maxDataTickMilliseconds > 0)
+        {
+            // at least one resource is processed in every tick
+            finished = processed > 0
+                && elapsed() >= options.maxDataTickMilliseconds * 1000;
+        }
+        else
+            finished = processed >= options.maxResourceProcessesPerTick;
+        if (finished)
+            return false;
+        processed++;
+        return true;
+    }
+
+    bool exhausted() const
+    {
+        return finished;
+    }
+
+    // microseconds since the beginning of the tick
+    uint32 elapsed() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    const MapOptions &options;
+    const std::chrono::steady_clock::time_point start;
+    uint32 processed;
+    bool finished;
+};
+
 } // namespace
 
-MapImpl::Resources::Resources() : downloads(0), tickIndex(0),
-    progressEstimationMaxResources(0)
+MapImpl::Resources::Resources() : lruFirst(nullptr), lruLast(nullptr),
+    parkedFirst(nullptr), parkedLast(nullptr),
+    downloads(0), ramMemoryUse(0), gpuMemoryUse(0), stateEpoch(0),
+    renderTickIndex(0),
+    tickIndex(0), progressEstimationMaxResources(0), dataQueueGeneration(0),
+    touchedUnsettled(0), decodeStop(false), dataWork(false)
+{}
+
+ResourceKey::ResourceKey(uint32 source, Slot slot, const TileId &tileId,
+                         uint32 subMesh) :
+    tileId(tileId), source(source), subMesh(subMesh), slot(slot)
 {}
 
+bool ResourceKey::operator == (const ResourceKey &other) const
+{
+    return tileId == other.tileId && source == other.source
+            && subMesh == other.subMesh && slot == other.slot;
+}
+
+bool ResourceKey::operator < (const ResourceKey &other) const
+{
+    if (source != other.source)
+        return source < other.source;
+    if (slot != other.slot)
+        return slot < other.slot;
+    if (subMesh != other.subMesh)
+        return subMesh < other.subMesh;
+    return tileId < other.tileId;
+}
+
+std::size_t ResourceKey::hash() const
+{
+    uint64 a = ((uint64)source << 32) ^ ((uint64)subMesh << 8)
+            ^ ((uint64)slot << 5) ^ (uint64)tileId.lod;
+    uint64 b = ((uint64)tileId.x << 32) ^ (uint64)tileId.y;
+    return (std::size_t)mixBits(a ^ mixBits(b));
+}
+
+uint32 newResourceKeySource()
+{
+    static std::atomic<uint32> source(0);
+    return source++;
+}
+
 bool FetchTask::isResourceTypeMandatory(FetchTask::ResourceType resourceType)
 {
     return !allowDiskCache(resourceType);
@@ -128,8 +428,13 @@ Resource::Resource(vts::MapImpl *map, const std::string &name,
     FetchTask(name, resourceType), name(name), map(map),
     state(State::initializing), retryTime(-1), retryNumber(0),
     redirectionsCount(0), lastAccessTick(0),
+    ramMemoryAccounted(0), gpuMemoryAccounted(0),
+    revalidateRamMemoryCost(0), revalidateGpuMemoryCost(0),
+    revalidateLoaded(false), contentDecoded(false),
     priority(std::numeric_limits<float>::quiet_NaN()),
-    priorityCopy(std::numeric_limits<float>::quiet_NaN())
+    priorityCopy(std::numeric_limits<float>::quiet_NaN()),
+    dataQueueIndex(InvalidQueueIndex), dataQueueGeneration(0),
+    lruPrev(nullptr), lruNext(nullptr), lruParked(false)
 {
     LOG(debug) << "Constructing resource <" << name
                << "> at <" << this << ">";
@@ -146,6 +451,17 @@ Resource::operator bool() const
     return state == Resource::State::ready;
 }
 
+void Resource::accountMemory()
+{
+    // update the totals by the difference since the last call
+    map->resources.ramMemoryUse += info.ramMemoryCost;
+    map->resources.ramMemoryUse -= ramMemoryAccounted;
+    map->resources.gpuMemoryUse += info.gpuMemoryCost;
+    map->resources.gpuMemoryUse -= gpuMemoryAccounted;
+    ramMemoryAccounted = info.ramMemoryCost;
+    gpuMemoryAccounted = info.gpuMemoryCost;
+}
+
 std::ostream &operator << (std::ostream &stream, Resource::State state)
 {
     switch (state)
@@ -159,6 +475,12 @@ std::ostream &operator << (std::ostream &stream, Resource::State state)
         case Resource::State::downloaded:
             stream << "downloaded";
             break;
+        case Resource::State::decoding:
+            stream << "decoding";
+            break;
+        case Resource::State::decoded:
+            stream << "decoded";
+            break;
         case Resource::State::ready:
             stream << "ready";
             break;
@@ -184,13 +506,28 @@ void MapImpl::resourceInitializeDownload(const std::shared_ptr<Resource> &r)
     assert(r->state == Resource::State::initializing);
     r->reply.content.free();
     std::string().swap(r->reply.contentType);
+    std::string().swap(r->reply.etag);
+    std::string().swap(r->reply.lastModified);
     r->reply.code = 0;
     r->reply.expires = -1;
     r->info.gpuMemoryCost = r->info.ramMemoryCost = 0;
+    r->accountMemory();
+    r->contentDecoded = false;
     try
     {
-        if (allowDiskCache(r->query.resourceType) && resources.cache->read(
-                    r->name, r->reply.content, r->reply.expires))
+        if (r->allowDecodedCache() && resources.cache->read(
+                    cacheDecodedName(r->name), r->reply.content,
+                    r->reply.expires))
+        {
+            statistics.resourcesDiskLoaded++;
+            statistics.resourcesDecodedLoaded++;
+            r->contentDecoded = true;
+            r->state = Resource::State::downloaded;
+            r->reply.code = 200;
+        }
+        else if (allowDiskCache(r->query.resourceType)
+                 && resources.cache->read(r->name, r->reply.content,
+                                          r->reply.expires))
         {
             statistics.resourcesDiskLoaded++;
             if (r->reply.content.size() > 0)
@@ -217,6 +554,8 @@ void MapImpl::resourceInitializeDownload(const std::shared_ptr<Resource> &r)
             resources.downloads++;
             r->state = Resource::State::downloading;
             initializeFetchTask(this, r);
+            setConditionalHeaders(this, r);
+            resources.fetching.push_back(r);
             resources.fetcher->fetch(r);
         }
     }
@@ -227,44 +566,138 @@ void MapImpl::resourceInitializeDownload(const std::shared_ptr<Resource> &r)
         LOG(err3) << "Failed loading resource <" << r->name
                   << ">, exception <" << e.what() << ">";
     }
+    resources.stateEpoch++;
 }
 
-void Resource::processLoad()
+void Resource::decode()
+{}
+
+bool Resource::allowDecodedCache() const
+{
+    if (!map->createOptions.cacheDecodedResources
+            || map->createOptions.disableCache
+            || startsWith(name, "file://")
+            || startsWith(name, "internal://"))
+        return false;
+    switch (query.resourceType)
+    {
+    case Resource::ResourceType::Mesh:
+    case Resource::ResourceType::Texture:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Resource::writeDecodedCache(const Buffer &buffer)
+{
+    // decoded data are cheap to recreate, they are evicted first
+    //   and stored uncompressed
+    map->resources.cache->write(cacheDecodedName(name), buffer,
+                                reply.expires,
+                                FetchTask::ResourceType::Decoded,
+                                CacheValidators());
+}
+
+void Resource::prepareLoad()
 {
     assert(state == Resource::State::downloaded);
+    revalidateLoaded = false;
     info.gpuMemoryCost = info.ramMemoryCost = 0;
+    accountMemory();
     map->statistics.resourcesProcessed++;
+    state = Resource::State::decoding;
+}
+
+void Resource::processDecode()
+{
+    assert(state == Resource::State::decoding);
     try
     {
-        load();
-        state = Resource::State::ready;
+        decode();
+        state = Resource::State::decoded;
     }
     catch (const std::exception &e)
     {
-        LOG(err3) << "Failed processing resource <" << name
-                  << ">, exception <" << e.what() << ">";
-        if (map->options.debugSaveCorruptedFiles)
+        if (!contentDecoded)
         {
-            std::string path = std::string() + "corrupted/"
-                    + convertNameToPath(name, false);
-            try
-            {
-                writeLocalFileBuffer(path, reply.content);
-                LOG(info1) << "Resource <" << name
-                           << "> saved into file <"
-                           << path << "> for further inspection";
-            }
-            catch(...)
-            {
-                LOG(warn1) << "Failed saving resource <" << name
-                           << "> into file <"
-                           << path << "> for further inspection";
-            }
+            processFailed(e);
+            return;
+        }
+
+        // the decoded entry is corrupted or outdated,
+        //   it is replaced with an entry that is never read
+        //   and the resource is decoded from the source data instead
+        LOG(warn2) << "Discarding decoded cache entry of <" << name
+                   << ">, exception <" << e.what() << ">";
+        map->resources.cache->write(cacheDecodedName(name), Buffer(), -2,
+                                    FetchTask::ResourceType::Decoded,
+                                    CacheValidators());
+        contentDecoded = false;
+        reply.content.free();
+        if (allowDiskCache(query.resourceType)
+                && map->resources.cache->read(name, reply.content,
+                                              reply.expires))
+            processDecode();
+        else
+            state = Resource::State::initializing; // download it again
+    }
+}
+
+void Resource::processUpload()
+{
+    assert(state == Resource::State::decoded
+           || state == Resource::State::errorFatal
+           || state == Resource::State::initializing);
+    if (state == Resource::State::decoded)
+    {
+        try
+        {
+            load();
+            state = Resource::State::ready;
+        }
+        catch (const std::exception &e)
+        {
+            processFailed(e);
         }
-        map->statistics.resourcesFailed++;
-        state = Resource::State::errorFatal;
     }
+    if (state == Resource::State::errorFatal)
+        map->statistics.resourcesFailed++;
     reply.content.free();
+    accountMemory();
+    map->resources.stateEpoch++;
+}
+
+void Resource::processLoad()
+{
+    prepareLoad();
+    processDecode();
+    processUpload();
+}
+
+void Resource::processFailed(const std::exception &e)
+{
+    LOG(err3) << "Failed processing resource <" << name
+              << ">, exception <" << e.what() << ">";
+    if (map->options.debugSaveCorruptedFiles)
+    {
+        std::string path = std::string() + "corrupted/"
+                + convertNameToPath(name, false);
+        try
+        {
+            writeLocalFileBuffer(path, reply.content);
+            LOG(info1) << "Resource <" << name
+                       << "> saved into file <"
+                       << path << "> for further inspection";
+        }
+        catch(...)
+        {
+            LOG(warn1) << "Failed saving resource <" << name
+                       << "> into file <"
+                       << path << "> for further inspection";
+        }
+    }
+    state = Resource::State::errorFatal;
 }
 
 void MapImpl::resourceDataInitialize(const std::shared_ptr<Fetcher> &fetcher)
@@ -273,11 +706,13 @@ void MapImpl::resourceDataInitialize(const std::shared_ptr<Fetcher> &fetcher)
     assert(fetcher);
     resources.fetcher = fetcher;
     fetcher->initialize();
+    resourceDecodeInitialize();
 }
 
 void MapImpl::resourceDataFinalize()
 {
     LOG(info3) << "Data finalize";
+    resourceDecodeFinalize();
     assert(resources.fetcher);
     resources.fetcher->finalize();
     resources.fetcher.reset();
@@ -285,54 +720,214 @@ void MapImpl::resourceDataFinalize()
         boost::lock_guard<boost::mutex> l(resources.mutResourcesCopy);
         resources.resourcesCopy.clear();
     }
+    for (auto &it : resources.dataQueue)
+        it->dataQueueIndex = InvalidQueueIndex;
+    resources.dataQueue.clear();
+    resources.fetching.clear();
 }
 
 bool MapImpl::resourceDataTick()
 {
     statistics.resourcesDownloading = resources.downloads;
+    resources.cache->updateStatistics(statistics);
+    resources.fetcher->hostStatistics(resources.fetcherHosts);
+    statistics.resourcesFetchQueued = 0;
+    for (auto &it : resources.fetcherHosts)
+        statistics.resourcesFetchQueued += it.queued;
+    DataTickBudget budget(options);
+    uint32 deferred = 0;
+
+    // upload resources finished by the decode threads
+    if (!resources.decodeThreads.empty())
+    {
+        while (true)
+        {
+            std::shared_ptr<Resource> r;
+            {
+                boost::lock_guard<boost::mutex> l(resources.mutDecode);
+                statistics.resourcesDecoding = resources.decodeQueue.size()
+                        + resources.decodedQueue.size();
+                if (resources.decodedQueue.empty())
+                    break;
+                if (!budget.next())
+                {
+                    deferred += resources.decodedQueue.size();
+                    break;
+                }
+                r = std::move(resources.decodedQueue.front());
+                resources.decodedQueue.pop_front();
+            }
+            r->processUpload();
+        }
+    }
+
+    resourceCancelStaleDownloads();
 
     // sync resources
     std::vector<std::shared_ptr<Resource>> res;
     {
         boost::lock_guard<boost::mutex> l(resources.mutResourcesCopy);
-        if (resources.resourcesCopy.empty())
-            return true; // all done
         res.swap(resources.resourcesCopy);
     }
 
-    // sort resources by priority
+    // merge the requests into the queue
+    if (!res.empty())
+        resources.dataQueueGeneration++;
     for (auto &it : res)
     {
         assert(it->priority == it->priority);
         it->priorityCopy = it->priority;
+        it->fetchPriority.store(it->priority, std::memory_order_relaxed);
         if (it->priority < std::numeric_limits<float>::infinity())
             it->priority = 0;
+        it->dataQueueGeneration = resources.dataQueueGeneration;
+        dataQueueUpdate(resources.dataQueue, it);
     }
-    std::sort(res.begin(), res.end(), [](
-              const std::shared_ptr<Resource> &a,
-              const std::shared_ptr<Resource> &b
-        ){ return a->priorityCopy > b->priorityCopy; });
 
-    // process the resources
-    uint32 processed = 0;
-    for (const std::shared_ptr<Resource> &r : res)
+    // process the resources in order of priority
+    while (!resources.dataQueue.empty())
     {
-        if (processed++ >= options.maxResourceProcessesPerTick)
-            return false; // tasks left
-        switch ((Resource::State)r->state)
+        const std::shared_ptr<Resource> &t = resources.dataQueue.front();
+        Resource::State s = t->state;
+        // downloads are started only for resources
+        //   that were requested in the last handoff
+        bool work = s == Resource::State::downloaded
+                || (s == Resource::State::initializing
+                    && t->dataQueueGeneration
+                        == resources.dataQueueGeneration);
+        if (work && !budget.next())
+            break;
+        std::shared_ptr<Resource> r = dataQueuePop(resources.dataQueue);
+        if (!work)
+            continue; // the resource state may have changed in another thread
+        switch (s)
         {
         case Resource::State::downloaded:
-            r->processLoad();
+            if (!resources.decodeThreads.empty()
+                    && allowDecodeThreads(r->query.resourceType))
+            {
+                r->prepareLoad();
+                boost::lock_guard<boost::mutex> l(resources.mutDecode);
+                resources.decodeQueue.push_back(r);
+                resources.condDecode.notify_one();
+            }
+            else
+                r->processLoad();
             break;
         case Resource::State::initializing:
             resourceInitializeDownload(r);
             break;
         default:
-            break; // the resource state may have changed in another thread
+            break;
         }
     }
+    deferred += resources.dataQueue.size();
+
+    statistics.currentDataTickMicroseconds = budget.elapsed();
+    statistics.currentDataTickDeferred = deferred;
+    if (deferred > 0)
+        resourceDataNotify(); // the next wait should not block
+    return deferred == 0; // false -> tasks left
+}
 
-    return true; // all done
+void MapImpl::resourceCancelStaleDownloads()
+{
+    // the render thread owns the tick index and the access ticks
+    uint32 tick = resources.renderTickIndex.load(std::memory_order_relaxed);
+    auto &f = resources.fetching;
+    f.erase(std::remove_if(f.begin(), f.end(),
+        [&](const std::shared_ptr<Resource> &r){
+        if (r->state != Resource::State::downloading)
+            return true;
+        if (options.fetchCancelStaleTicks == 0
+                || FetchTask::isResourceTypeMandatory(r->query.resourceType)
+                || r->lastAccessTick.load(std::memory_order_relaxed)
+                    + options.fetchCancelStaleTicks >= tick)
+            return false;
+        // a download that cannot be cancelled is not checked again,
+        //   it keeps counting towards the concurrent downloads
+        if (resources.fetcher->cancel(r))
+        {
+            LOG(info1) << "Cancelled download of <" << r->name << ">";
+            statistics.resourcesCancelled++;
+        }
+        return true;
+    }), f.end());
+}
+
+bool MapImpl::resourceDataWait(double timeout)
+{
+    boost::unique_lock<boost::mutex> l(resources.mutDataWork);
+    if (!resources.dataWork && timeout > 0)
+    {
+        resources.condDataWork.wait_for(l,
+                boost::chrono::microseconds((uint64)(timeout * 1e6)),
+                [&](){ return resources.dataWork; });
+    }
+    bool res = resources.dataWork;
+    resources.dataWork = false;
+    return res;
+}
+
+void MapImpl::resourceDataNotify()
+{
+    boost::lock_guard<boost::mutex> l(resources.mutDataWork);
+    resources.dataWork = true;
+    resources.condDataWork.notify_all();
+}
+
+////////////////////////////
+/// DECODE THREADS
+////////////////////////////
+
+void MapImpl::resourceDecodeInitialize()
+{
+    assert(resources.decodeThreads.empty());
+    resources.decodeStop = false;
+    for (uint32 i = 0; i < createOptions.decodeThreads; i++)
+    {
+        resources.decodeThreads.push_back(boost::thread(
+                    &MapImpl::resourceDecodeEntry, this, i));
+    }
+}
+
+void MapImpl::resourceDecodeFinalize()
+{
+    {
+        boost::lock_guard<boost::mutex> l(resources.mutDecode);
+        resources.decodeStop = true;
+        resources.condDecode.notify_all();
+    }
+    for (boost::thread &it : resources.decodeThreads)
+        it.join();
+    resources.decodeThreads.clear();
+    resources.decodeQueue.clear();
+    resources.decodedQueue.clear();
+}
+
+void MapImpl::resourceDecodeEntry(uint32 index)
+{
+    setLogThreadName(std::string() + "decode "
+                     + boost::lexical_cast<std::string>(index));
+    while (true)
+    {
+        std::shared_ptr<Resource> r;
+        {
+            boost::unique_lock<boost::mutex> l(resources.mutDecode);
+            while (!resources.decodeStop && resources.decodeQueue.empty())
+                resources.condDecode.wait(l);
+            if (resources.decodeStop)
+                return;
+            r = std::move(resources.decodeQueue.front());
+            resources.decodeQueue.pop_front();
+        }
+        r->processDecode();
+        {
+            boost::lock_guard<boost::mutex> l(resources.mutDecode);
+            resources.decodedQueue.push_back(std::move(r));
+        }
+        resourceDataNotify();
+    }
 }
 
 ////////////////////////////
@@ -365,10 +960,61 @@ void Resource::fetchDone()
 {
     LOG(debug) << "Resource <" << name << "> finished fetching";
     assert(map);
+    DataWorkNotifier notifier(map);
     assert(state == Resource::State::downloading);
     assert(info.ramMemoryCost == 0);
     assert(info.gpuMemoryCost == 0);
     map->resources.downloads--;
+    map->resources.stateEpoch++;
+
+    // cancelled downloads are restarted when requested again
+    if (reply.code == FetchTask::ExtraCodes::Cancelled)
+    {
+        reply.code = 0;
+        reply.content.free();
+        state = Resource::State::initializing;
+        return;
+    }
+
+    // the cached content has not changed
+    if (reply.code == 304)
+    {
+        if (!allowDiskCache(query.resourceType))
+            reply.expires = -2;
+        if (map->resources.cache->revalidate(name, reply.expires,
+                        revalidateLoaded ? nullptr : &reply.content))
+        {
+            LOG(info1) << "Resource <" << name << "> was not modified";
+            map->statistics.resourcesRevalidated++;
+            std::string().swap(query.url);
+            query.headers.clear();
+            retryNumber = 0;
+            reply.code = 200;
+            if (revalidateLoaded)
+            {
+                // keep the loaded content
+                revalidateLoaded = false;
+                info.ramMemoryCost = revalidateRamMemoryCost;
+                info.gpuMemoryCost = revalidateGpuMemoryCost;
+                accountMemory();
+                state = Resource::State::ready;
+            }
+            else
+            {
+                info.ramMemoryCost = reply.content.size();
+                accountMemory();
+                state = Resource::State::downloaded;
+            }
+            return;
+        }
+        // the entry was evicted from the cache in the meantime
+        //   the next attempt will not be conditional
+        LOG(warn2) << "Resource <" << name
+                   << "> was not modified, but it is no longer cached";
+        reply.content.free();
+        state = Resource::State::errorRetry;
+        return;
+    }
 
     // handle error or invalid codes
     if (reply.code >= 400 || reply.code < 200)
@@ -397,7 +1043,8 @@ void Resource::fetchDone()
                    << "> failed availability test";
         state = Resource::State::availFail;
         reply.content.free();
-        map->resources.cache->write(name, reply.content, reply.expires);
+        map->resources.cache->write(name, reply.content, reply.expires,
+                                    query.resourceType, CacheValidators());
     }
     std::string().swap(reply.contentType);
 
@@ -434,8 +1081,11 @@ void Resource::fetchDone()
 
     std::string().swap(query.url);
     query.headers.clear();
-    map->resources.cache->write(name, reply.content, reply.expires);
+    map->resources.cache->write(name, reply.content, reply.expires,
+                                query.resourceType,
+                                { reply.etag, reply.lastModified });
     info.ramMemoryCost = reply.content.size();
+    accountMemory();
     retryNumber = 0; // reset counter
     state = Resource::State::downloaded;
 }
@@ -454,8 +1104,15 @@ void Resource::updatePriority(float p)
 
 void Resource::reset()
 {
-    if (state == Resource::State::downloading)
+    switch ((Resource::State)state)
+    {
+    case Resource::State::downloading:
+    case Resource::State::decoding:
+    case Resource::State::decoded:
         return;
+    default:
+        break;
+    }
     retryNumber = 0;
     state = Resource::State::errorRetry;
 }
@@ -465,73 +1122,63 @@ void MapImpl::resourceRenderInitialize()
 
 void MapImpl::resourceRenderFinalize()
 {
+    resources.resourcesByKey.clear();
     resources.resources.clear();
+    resources.seedResources.clear();
+    resources.lruFirst = resources.lruLast = nullptr;
+    resources.parkedFirst = resources.parkedLast = nullptr;
+    resources.ramMemoryUse = resources.gpuMemoryUse = 0;
 }
 
 void MapImpl::resourceRenderTick()
 {
-    if (renderer.tickIndex % 4 == 0)
+    resources.renderTickIndex.store(renderer.tickIndex,
+                                    std::memory_order_relaxed);
+    resources.touched.clear();
+    resources.touchedUnsettled = 0;
+
+    // release long time not used resources
+    //   starting from the least recently used ones
     {
-        // clear old resources
-        struct Res
-        {
-            std::string s;
-            uint32 p;
-            bool operator < (const Res &other) const
-            {
-                return p < other.p;
-            }
-            Res(const std::string &s, uint32 p) : s(s), p(p)
-            {}
+        uint64 trs = (uint64)options.targetResourcesMemoryKB * 1024;
+        auto overTarget = [&](){
+            return resources.ramMemoryUse + resources.gpuMemoryUse > trs;
         };
-        std::vector<Res> resToRemove;
-        uint64 memRamUse = 0;
-        uint64 memGpuUse = 0;
-        for (auto &it : resources.resources)
+        // stale resources that were still used elsewhere
+        //   are rechecked a few at a time
+        uint32 parkedChecks = ParkedChecksPerTick;
+        Resource *r = resources.parkedFirst;
+        while (r && parkedChecks-- > 0 && overTarget())
         {
-            memRamUse += it.second->info.ramMemoryCost;
-            memGpuUse += it.second->info.gpuMemoryCost;
-            // consider long time not used resources only
-            if (it.second->lastAccessTick + 5 < renderer.tickIndex)
-                resToRemove.emplace_back(it.first, it.second->lastAccessTick);
+            Resource *next = r->lruNext;
+            if (!resourceRelease(r))
+                lruPark(resources, r); // move to the end of the parked list
+            r = next;
         }
-        uint64 memUse = memRamUse + memGpuUse;
-        uint64 trs = (uint64)options.targetResourcesMemoryKB * 1024;
-        if (memUse > trs)
+        r = resources.lruFirst;
+        while (r && r->lastAccessTick + 5 < renderer.tickIndex
+               && overTarget())
         {
-            std::sort(resToRemove.begin(), resToRemove.end());
-            for (Res &res : resToRemove)
+            Resource *next = r->lruNext;
+            if (!resourceRelease(r))
             {
-                auto &it = resources.resources[res.s];
-                std::string name = it->name;
-                uint64 mem = it->info.gpuMemoryCost + it->info.ramMemoryCost;
-                releaseIfLast(it);
-                if (!it)
-                {
-                    LOG(info1) << "Released resource <" << name << ">";
-                    resources.resources.erase(name);
-                    statistics.resourcesReleased++;
-                    memUse -= mem;
-                    if (memUse <= trs)
-                        break;
-                }
+                // the resource is still used elsewhere, reconsider it later
+                lruPark(resources, r);
             }
+            r = next;
         }
-        statistics.currentGpuMemUseKB = memGpuUse / 1024;
-        statistics.currentRamMemUseKB = memRamUse / 1024;
+        statistics.currentGpuMemUseKB = resources.gpuMemoryUse / 1024;
+        statistics.currentRamMemUseKB = resources.ramMemoryUse / 1024;
     }
 
     if (renderer.tickIndex % 4 == 2)
     {
         // check which resources need attention
+        //   resources accessed in previous tick are at the end of the list
         std::vector<std::shared_ptr<Resource>> res;
-        res.reserve(resources.resources.size());
         std::time_t current = std::time(nullptr);
-        for (auto it : resources.resources)
+        auto attention = [&](const std::shared_ptr<Resource> &r)
         {
-            const std::shared_ptr<Resource> &r = it.second;
-            if (r->lastAccessTick + 1 != renderer.tickIndex)
-                continue;
             switch ((Resource::State)r->state)
             {
             case Resource::State::errorRetry:
@@ -540,6 +1187,7 @@ void MapImpl::resourceRenderTick()
                     LOG(err3) << "All retries for resource <" << r->name
                                << "> have failed";
                     r->state = Resource::State::errorFatal;
+                    resources.stateEpoch++;
                     statistics.resourcesFailed++;
                     break;
                 }
@@ -573,30 +1221,126 @@ void MapImpl::resourceRenderTick()
                                << "> has expired (expiration: "
                                << r->reply.expires << ", current: "
                                << current << ")";
+                    r->revalidateRamMemoryCost = r->info.ramMemoryCost;
+                    r->revalidateGpuMemoryCost = r->info.gpuMemoryCost;
+                    r->revalidateLoaded = true;
                     r->state = Resource::State::initializing;
+                    resources.stateEpoch++;
                     res.push_back(r);
                 }
                 break;
             case Resource::State::downloading:
+            case Resource::State::decoding:
+            case Resource::State::decoded:
             case Resource::State::errorFatal:
             case Resource::State::availFail:
                 break;
             }
+        };
+        for (Resource *p = resources.lruLast;
+             p && p->lastAccessTick + 1 >= renderer.tickIndex;
+             p = p->lruPrev)
+        {
+            if (p->lastAccessTick + 1 != renderer.tickIndex)
+                continue;
+            const std::shared_ptr<Resource> &r
+                    = resources.resources.find(p->name)->second;
+            assert(r.get() == p);
+            attention(r);
+        }
+        // seed downloads are not in the lru list
+        {
+            auto it = resources.seedResources.begin();
+            while (it != resources.seedResources.end())
+            {
+                const std::shared_ptr<SeedResource> &r = it->second;
+                if (r.use_count() == 1)
+                {
+                    // no seed task needs it anymore
+                    resources.ramMemoryUse -= r->ramMemoryAccounted;
+                    resources.gpuMemoryUse -= r->gpuMemoryAccounted;
+                    resources.stateEpoch++;
+                    it = resources.seedResources.erase(it);
+                    continue;
+                }
+                if (r->lastAccessTick + 1 == renderer.tickIndex)
+                    attention(r);
+                it++;
+            }
         }
         statistics.resourcesPreparing = res.size() + resources.downloads;
         // sync resources copy
+        bool notify = !res.empty();
         {
             boost::lock_guard<boost::mutex> l(resources.mutResourcesCopy);
             res.swap(resources.resourcesCopy);
         }
+        if (notify)
+            resourceDataNotify();
     }
 
     statistics.resourcesActive = resources.resources.size();
 }
 
-void MapImpl::touchResource(const std::shared_ptr<Resource> &resource)
+bool MapImpl::resourceRelease(Resource *r)
 {
+    auto it = resources.resources.find(r->name);
+    assert(it != resources.resources.end());
+    assert(it->second.get() == r);
+    if (it->second.use_count() > 1)
+        return false;
+    LOG(info1) << "Released resource <" << r->name << ">";
+    for (const ResourceKey &k : r->keys)
+        resources.resourcesByKey.erase(k);
+    lruUnlink(resources, r);
+    resources.ramMemoryUse -= r->ramMemoryAccounted;
+    resources.gpuMemoryUse -= r->gpuMemoryAccounted;
+    resources.resources.erase(it);
+    resources.stateEpoch++;
+    statistics.resourcesReleased++;
+    return true;
+}
+
+void MapImpl::resourceInsert(const std::shared_ptr<Resource> &resource)
+{
+    assert(resources.resources.find(resource->name)
+           == resources.resources.end());
+    resources.resources[resource->name] = resource;
     resource->lastAccessTick = renderer.tickIndex;
+    resources.touched.push_back(resource.get());
+    if (!stateSettled(resource->state))
+        resources.touchedUnsettled++;
+    lruLink(resources, resource.get());
+}
+
+void MapImpl::touchResource(const std::shared_ptr<Resource> &resource)
+{
+    touchResource(resource.get());
+}
+
+void MapImpl::touchResource(Resource *r)
+{
+    if (r->lastAccessTick.load(std::memory_order_relaxed)
+            == renderer.tickIndex)
+        return;
+    r->lastAccessTick.store(renderer.tickIndex, std::memory_order_relaxed);
+    resources.touched.push_back(r);
+    if (!stateSettled(r->state))
+        resources.touchedUnsettled++;
+    // resources owned by other resources are not in the list
+    if (lruLinked(resources, r))
+    {
+        lruUnlink(resources, r);
+        lruLink(resources, r);
+    }
+}
+
+void MapImpl::touchResourcesRepeat()
+{
+    // touches the same resources as the last traversed frame
+    //   independently of the order of the lru list
+    for (Resource *r : renderer.lastFrame.touched)
+        touchResource(r);
 }
 
 std::shared_ptr<GpuTexture> MapImpl::getTexture(const std::string &name)
@@ -604,6 +1348,12 @@ std::shared_ptr<GpuTexture> MapImpl::getTexture(const std::string &name)
     return getMapResource<GpuTexture>(this, name);
 }
 
+std::shared_ptr<GpuTexture> MapImpl::getTexture(const ResourceKey &key,
+        const UrlTemplate &url, const UrlTemplate::Vars &vars)
+{
+    return getMapResource<GpuTexture>(this, key, url, vars);
+}
+
 std::shared_ptr<GpuMesh> MapImpl::getMesh(const std::string &name)
 {
     return getMapResource<GpuMesh>(this, name);
@@ -624,6 +1374,12 @@ std::shared_ptr<MetaTile> MapImpl::getMetaTile(const std::string &name)
     return getMapResource<MetaTile>(this, name);
 }
 
+std::shared_ptr<MetaTile> MapImpl::getMetaTile(const ResourceKey &key,
+        const UrlTemplate &url, const UrlTemplate::Vars &vars)
+{
+    return getMapResource<MetaTile>(this, key, url, vars);
+}
+
 std::shared_ptr<NavTile> MapImpl::getNavTile(
         const std::string &name)
 {
@@ -636,6 +1392,13 @@ std::shared_ptr<MeshAggregate> MapImpl::getMeshAggregate(
     return getMapResource<MeshAggregate>(this, name);
 }
 
+std::shared_ptr<MeshAggregate> MapImpl::getMeshAggregate(
+        const ResourceKey &key, const UrlTemplate &url,
+        const UrlTemplate::Vars &vars)
+{
+    return getMapResource<MeshAggregate>(this, key, url, vars);
+}
+
 std::shared_ptr<ExternalBoundLayer> MapImpl::getExternalBoundLayer(
         const std::string &name)
 {
@@ -654,6 +1417,13 @@ std::shared_ptr<BoundMetaTile> MapImpl::getBoundMetaTile(
     return getMapResource<BoundMetaTile>(this, name);
 }
 
+std::shared_ptr<BoundMetaTile> MapImpl::getBoundMetaTile(
+        const ResourceKey &key, const UrlTemplate &url,
+        const UrlTemplate::Vars &vars)
+{
+    return getMapResource<BoundMetaTile>(this, key, url, vars);
+}
+
 std::shared_ptr<SearchTaskImpl> MapImpl::getSearchTask(const std::string &name)
 {
     return getMapResource<SearchTaskImpl>(this, name);
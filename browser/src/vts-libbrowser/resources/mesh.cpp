@@ -65,18 +65,24 @@ GpuMesh::GpuMesh(MapImpl *map, const std::string &name) :
     Resource(map, name, FetchTask::ResourceType::General)
 {}
 
+void GpuMesh::decode()
+{
+    LOG(info1) << "Decoding (gpu) mesh '" << name << "'";
+    decoded = GpuMeshSpec(reply.content);
+    decoded.attributes[0].enable = true;
+    decoded.attributes[0].stride = sizeof(vec3f) + sizeof(vec2f);
+    decoded.attributes[0].components = 3;
+    decoded.attributes[1].enable = true;
+    decoded.attributes[1].stride = decoded.attributes[0].stride;
+    decoded.attributes[1].components = 2;
+    decoded.attributes[1].offset = sizeof(vec3f);
+    decoded.attributes[2] = decoded.attributes[1];
+}
+
 void GpuMesh::load()
 {
     LOG(info1) << "Loading (gpu) mesh '" << name << "'";
-    GpuMeshSpec spec(reply.content);
-    spec.attributes[0].enable = true;
-    spec.attributes[0].stride = sizeof(vec3f) + sizeof(vec2f);
-    spec.attributes[0].components = 3;
-    spec.attributes[1].enable = true;
-    spec.attributes[1].stride = spec.attributes[0].stride;
-    spec.attributes[1].components = 2;
-    spec.attributes[1].offset = sizeof(vec3f);
-    spec.attributes[2] = spec.attributes[1];
+    GpuMeshSpec spec(std::move(decoded));
     map->callbacks.loadMesh(info, spec);
     info.ramMemoryCost += sizeof(*this);
 }
@@ -100,15 +106,175 @@ const mat4 findNormToPhys(const math::Extents3 &extents)
     return tr * sc;
 }
 
+std::shared_ptr<GpuMesh> submeshRenderable(MapImpl *map,
+        const std::string &name, uint32 index)
+{
+    char tmp[10];
+    sprintf(tmp, "%d", index);
+    std::shared_ptr<GpuMesh> gm = std::make_shared<GpuMesh>(map,
+        name + "#$!" + tmp);
+    gm->state = Resource::State::errorFatal;
+    return gm;
+}
+
+// layout of a mesh in the cache of decoded resources
+//   number of submeshes (uint32) is followed by each submesh header
+//   and its vertices and indices
+struct DecodedAttribute
+{
+    uint32 offset;
+    uint32 stride;
+    uint32 components;
+    uint32 type;
+    uint32 enable;
+    uint32 normalized;
+};
+
+struct DecodedSubmesh
+{
+    double normToPhys[16]; // without renderTilesScale
+    DecodedAttribute attributes[4];
+    uint32 textureLayer;
+    uint32 surfaceReference;
+    uint32 internalUv;
+    uint32 externalUv;
+    uint32 verticesCount;
+    uint32 indicesCount;
+    uint32 faceMode;
+    uint32 verticesSize;
+    uint32 indicesSize;
+};
+
+Buffer encodeDecoded(const std::vector<MeshPart> &parts,
+                     const std::vector<mat4> &normToPhys,
+                     const std::vector<GpuMeshSpec> &specs)
+{
+    assert(parts.size() == specs.size());
+    assert(parts.size() == normToPhys.size());
+    uint32 size = sizeof(uint32);
+    for (const GpuMeshSpec &s : specs)
+        size += sizeof(DecodedSubmesh) + s.vertices.size() + s.indices.size();
+    Buffer out(size);
+    char *p = out.data();
+    uint32 count = parts.size();
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+    for (uint32 i = 0; i < count; i++)
+    {
+        const MeshPart &part = parts[i];
+        const GpuMeshSpec &s = specs[i];
+        DecodedSubmesh h;
+        memset(&h, 0, sizeof(h)); // initialize structure padding
+        memcpy(h.normToPhys, normToPhys[i].data(), sizeof(h.normToPhys));
+        for (uint32 a = 0; a < 4; a++)
+        {
+            const GpuMeshSpec::VertexAttribute &sa = s.attributes[a];
+            DecodedAttribute &ha = h.attributes[a];
+            ha.offset = sa.offset;
+            ha.stride = sa.stride;
+            ha.components = sa.components;
+            ha.type = (uint32)sa.type;
+            ha.enable = sa.enable;
+            ha.normalized = sa.normalized;
+        }
+        h.textureLayer = part.textureLayer;
+        h.surfaceReference = part.surfaceReference;
+        h.internalUv = part.internalUv;
+        h.externalUv = part.externalUv;
+        h.verticesCount = s.verticesCount;
+        h.indicesCount = s.indicesCount;
+        h.faceMode = (uint32)s.faceMode;
+        h.verticesSize = s.vertices.size();
+        h.indicesSize = s.indices.size();
+        memcpy(p, &h, sizeof(h));
+        p += sizeof(h);
+        memcpy(p, s.vertices.data(), h.verticesSize);
+        p += h.verticesSize;
+        memcpy(p, s.indices.data(), h.indicesSize);
+        p += h.indicesSize;
+    }
+    assert(p == out.data() + out.size());
+    return out;
+}
+
+void decodeDecoded(MapImpl *map, const std::string &name, Buffer &&buffer,
+                   std::vector<MeshPart> &parts,
+                   std::vector<GpuMeshSpec> &specs)
+{
+    // the vertices and indices are referenced without copying
+    auto owner = std::make_shared<Buffer>(std::move(buffer));
+    const char *p = owner->data();
+    const char *e = p + owner->size();
+    uint32 count;
+    if (e - p < (sint64)sizeof(count))
+        LOGTHROW(err1, std::runtime_error) << "Invalid decoded mesh";
+    memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+    parts.clear();
+    parts.reserve(count);
+    specs.clear();
+    specs.reserve(count);
+    for (uint32 i = 0; i < count; i++)
+    {
+        DecodedSubmesh h;
+        if (e - p < (sint64)sizeof(h))
+            LOGTHROW(err1, std::runtime_error) << "Invalid decoded mesh";
+        memcpy(&h, p, sizeof(h));
+        p += sizeof(h);
+        if (e - p < (sint64)h.verticesSize + h.indicesSize)
+            LOGTHROW(err1, std::runtime_error) << "Invalid decoded mesh";
+
+        GpuMeshSpec s;
+        for (uint32 a = 0; a < 4; a++)
+        {
+            GpuMeshSpec::VertexAttribute &sa = s.attributes[a];
+            const DecodedAttribute &ha = h.attributes[a];
+            sa.offset = ha.offset;
+            sa.stride = ha.stride;
+            sa.components = ha.components;
+            sa.type = (GpuTypeEnum)ha.type;
+            sa.enable = !!ha.enable;
+            sa.normalized = !!ha.normalized;
+        }
+        s.verticesCount = h.verticesCount;
+        s.indicesCount = h.indicesCount;
+        s.faceMode = (GpuMeshSpec::FaceMode)h.faceMode;
+        s.vertices = Buffer((char*)p, h.verticesSize, owner);
+        p += h.verticesSize;
+        if (h.indicesSize)
+            s.indices = Buffer((char*)p, h.indicesSize, owner);
+        p += h.indicesSize;
+        specs.push_back(std::move(s));
+
+        MeshPart part;
+        part.renderable = submeshRenderable(map, name, i);
+        memcpy(part.normToPhys.data(), h.normToPhys, sizeof(h.normToPhys));
+        part.normToPhys = part.normToPhys
+                * scaleMatrix(map->options.renderTilesScale);
+        part.textureLayer = h.textureLayer;
+        part.surfaceReference = h.surfaceReference;
+        part.internalUv = !!h.internalUv;
+        part.externalUv = !!h.externalUv;
+        parts.push_back(part);
+    }
+}
+
 } // namespace
 
 MeshAggregate::MeshAggregate(MapImpl *map, const std::string &name) :
     Resource(map, name, FetchTask::ResourceType::Mesh)
 {}
 
-void MeshAggregate::load()
+void MeshAggregate::decode()
 {
-    LOG(info2) << "Loading (aggregated) mesh <" << name << ">";
+    if (contentDecoded)
+    {
+        decodeDecoded(map, name, std::move(reply.content),
+                      submeshes, decoded);
+        return;
+    }
+
+    LOG(info2) << "Decoding (aggregated) mesh <" << name << ">";
 
     detail::Wrapper w(reply.content);
     vtslibs::vts::NormalizedSubMesh::list meshes = vtslibs::vts::
@@ -116,16 +282,16 @@ void MeshAggregate::load()
 
     submeshes.clear();
     submeshes.reserve(meshes.size());
+    decoded.clear();
+    decoded.reserve(meshes.size());
+    std::vector<mat4> normToPhys;
+    normToPhys.reserve(meshes.size());
 
     for (uint32 mi = 0, me = meshes.size(); mi != me; mi++)
     {
         vtslibs::vts::SubMesh &m = meshes[mi].submesh;
 
-        char tmp[10];
-        sprintf(tmp, "%d", mi);
-        std::shared_ptr<GpuMesh> gm = std::make_shared<GpuMesh>(map,
-            name + "#$!" + tmp);
-        gm->state = Resource::State::errorFatal;
+        std::shared_ptr<GpuMesh> gm = submeshRenderable(map, name, mi);
 
         uint32 vertexSize = sizeof(vec3f);
         if (m.tc.size())
@@ -198,7 +364,8 @@ void MeshAggregate::load()
 
         MeshPart part;
         part.renderable = gm;
-        part.normToPhys = findNormToPhys(meshes[mi].extents) 
+        normToPhys.push_back(findNormToPhys(meshes[mi].extents));
+        part.normToPhys = normToPhys.back()
                 * scaleMatrix(map->options.renderTilesScale);
         part.internalUv = spec.attributes[1].enable;
         part.externalUv = spec.attributes[2].enable;
@@ -212,7 +379,7 @@ void MeshAggregate::load()
             std::string b, c;
             std::string path = prefix
                     + convertNameToFolderAndFile(this->name, b, c)
-                    + "_" + tmp + ".obj";
+                    + "_" + std::to_string(mi) + ".obj";
             if (!boost::filesystem::exists(path))
             {
                 boost::filesystem::create_directories(prefix + b);
@@ -241,7 +408,24 @@ void MeshAggregate::load()
             }
         }
 
-        map->callbacks.loadMesh(gm->info, spec);
+        decoded.push_back(std::move(spec));
+    }
+
+    if (allowDecodedCache())
+        writeDecodedCache(encodeDecoded(submeshes, normToPhys, decoded));
+}
+
+void MeshAggregate::load()
+{
+    LOG(info2) << "Loading (aggregated) mesh <" << name << ">";
+    assert(decoded.size() == submeshes.size());
+
+    std::vector<GpuMeshSpec> specs;
+    specs.swap(decoded);
+    for (uint32 mi = 0, me = submeshes.size(); mi != me; mi++)
+    {
+        const std::shared_ptr<GpuMesh> &gm = submeshes[mi].renderable;
+        map->callbacks.loadMesh(gm->info, specs[mi]);
         gm->state = Resource::State::ready;
     }
 
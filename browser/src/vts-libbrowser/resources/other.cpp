@@ -37,12 +37,16 @@ MetaTile::MetaTile(vts::MapImpl *map, const std::string &name) :
     vtslibs::vts::MetaTile(vtslibs::vts::TileId(), 0)
 {}
 
-void MetaTile::load()
+void MetaTile::decode()
 {
-    LOG(info2) << "Loading meta tile <" << name << ">";
+    LOG(info2) << "Decoding meta tile <" << name << ">";
     detail::Wrapper w(reply.content);
     *(vtslibs::vts::MetaTile*)this
             = vtslibs::vts::loadMetaTile(w, 5, name);
+}
+
+void MetaTile::load()
+{
     info.ramMemoryCost += sizeof(*this);
     uint32 side = 1 << 5;
     info.ramMemoryCost += side * side * sizeof(vtslibs::vts::MetaNode);
@@ -52,9 +56,9 @@ NavTile::NavTile(MapImpl *map, const std::string &name) :
     Resource(map, name, FetchTask::ResourceType::NavTile)
 {}
 
-void NavTile::load()
+void NavTile::decode()
 {
-    LOG(info2) << "Loading navigation tile <" << name << ">";
+    LOG(info2) << "Decoding navigation tile <" << name << ">";
     GpuTextureSpec spec;
     decodeImage(reply.content, spec.buffer,
                 spec.width, spec.height, spec.components);
@@ -62,6 +66,10 @@ void NavTile::load()
         LOGTHROW(err1, std::runtime_error) << "invalid navtile image";
     data.resize(256 * 256);
     memcpy(data.data(), spec.buffer.data(), 256 * 256);
+}
+
+void NavTile::load()
+{
     info.ramMemoryCost += sizeof(*this);
     info.ramMemoryCost += data.size();
 }
@@ -76,9 +84,9 @@ BoundMetaTile::BoundMetaTile(MapImpl *map, const std::string &name) :
     Resource(map, name, FetchTask::ResourceType::BoundMetaTile)
 {}
 
-void BoundMetaTile::load()
+void BoundMetaTile::decode()
 {
-    LOG(info2) << "Loading bound meta tile <" << name << ">";
+    LOG(info2) << "Decoding bound meta tile <" << name << ">";
     Buffer buffer = std::move(reply.content);
     GpuTextureSpec spec;
     decodeImage(buffer, spec.buffer,
@@ -87,8 +95,12 @@ void BoundMetaTile::load()
         LOGTHROW(err1, std::runtime_error)
                 << "bound meta tile has invalid resolution";
     memcpy(flags, spec.buffer.data(), spec.buffer.size());
+}
+
+void BoundMetaTile::load()
+{
     info.ramMemoryCost += sizeof(*this);
-    info.ramMemoryCost += spec.buffer.size();
+    info.ramMemoryCost += sizeof(flags);
 }
 
 ExternalBoundLayer::ExternalBoundLayer(MapImpl *map, const std::string &name)
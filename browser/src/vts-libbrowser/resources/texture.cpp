@@ -73,14 +73,72 @@ Buffer GpuTextureSpec::encodePng() const
     return out;
 }
 
+namespace
+{
+
+// layout of a texture in the cache of decoded resources
+//   the header is followed by the pixels
+struct DecodedHeader
+{
+    uint32 width;
+    uint32 height;
+    uint32 components;
+    uint32 type;
+    uint32 internalFormat;
+    uint32 size;
+};
+
+Buffer encodeDecoded(const GpuTextureSpec &spec)
+{
+    DecodedHeader h;
+    h.width = spec.width;
+    h.height = spec.height;
+    h.components = spec.components;
+    h.type = (uint32)spec.type;
+    h.internalFormat = spec.internalFormat;
+    h.size = spec.buffer.size();
+    Buffer out(sizeof(h) + h.size);
+    memcpy(out.data(), &h, sizeof(h));
+    memcpy(out.data() + sizeof(h), spec.buffer.data(), h.size);
+    return out;
+}
+
+GpuTextureSpec decodeDecoded(Buffer &&buffer)
+{
+    DecodedHeader h;
+    if (buffer.size() < sizeof(h))
+        LOGTHROW(err1, std::runtime_error) << "Invalid decoded texture";
+    memcpy(&h, buffer.data(), sizeof(h));
+    if (buffer.size() != sizeof(h) + h.size)
+        LOGTHROW(err1, std::runtime_error) << "Invalid decoded texture";
+    GpuTextureSpec spec;
+    spec.width = h.width;
+    spec.height = h.height;
+    spec.components = h.components;
+    spec.type = (GpuTypeEnum)h.type;
+    spec.internalFormat = h.internalFormat;
+    // the pixels are referenced without copying
+    auto owner = std::make_shared<Buffer>(std::move(buffer));
+    spec.buffer = Buffer(owner->data() + sizeof(h), h.size, owner);
+    return spec;
+}
+
+} // namespace
+
 GpuTexture::GpuTexture(MapImpl *map, const std::string &name) :
     Resource(map, name, FetchTask::ResourceType::Texture)
 {}
 
-void GpuTexture::load()
+void GpuTexture::decode()
 {
-    LOG(info2) << "Loading (gpu) texture <" << name << ">";
-    GpuTextureSpec spec(reply.content);
+    if (contentDecoded)
+    {
+        decoded = decodeDecoded(std::move(reply.content));
+        return;
+    }
+
+    LOG(info2) << "Decoding (gpu) texture <" << name << ">";
+    decoded = GpuTextureSpec(reply.content);
 
     if (map->options.debugExtractRawResources)
     {
@@ -93,12 +151,22 @@ void GpuTexture::load()
         {
             boost::filesystem::create_directories(prefix + b);
             Buffer out;
-            encodePng(spec.buffer, out, spec.width, spec.height, spec.components);
+            encodePng(decoded.buffer, out, decoded.width, decoded.height,
+                      decoded.components);
             writeLocalFileBuffer(path, out);
         }
     }
 
-    spec.verticalFlip();
+    decoded.verticalFlip();
+
+    if (allowDecodedCache())
+        writeDecodedCache(encodeDecoded(decoded));
+}
+
+void GpuTexture::load()
+{
+    LOG(info2) << "Loading (gpu) texture <" << name << ">";
+    GpuTextureSpec spec(std::move(decoded));
     map->callbacks.loadTexture(info, spec);
     info.ramMemoryCost += sizeof(*this);
 }
@@ -0,0 +1,628 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <map>
+#include <unordered_set>
+
+#include "map.hpp"
+
+namespace vts
+{
+
+namespace
+{
+
+// limits of the work in progress
+//   the walk is depth first so that the memory use stays bounded
+static const uint32 MaxVisitingNodes = 64;
+static const uint32 SamplesPerType = 16; // downloaded by the estimate pass
+
+typedef std::vector<std::array<double, 2>> Polygon;
+
+vec2 polygonPoint(const Polygon &polygon, uint32 index)
+{
+    return vec2(polygon[index][0], polygon[index][1]);
+}
+
+// even-odd rule
+bool pointInPolygon(const Polygon &polygon, const vec2 &p)
+{
+    bool inside = false;
+    for (uint32 i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        vec2 a = polygonPoint(polygon, i);
+        vec2 b = polygonPoint(polygon, j);
+        if ((a(1) > p(1)) != (b(1) > p(1))
+            && p(0) < (b(0) - a(0)) * (p(1) - a(1)) / (b(1) - a(1)) + a(0))
+            inside = !inside;
+    }
+    return inside;
+}
+
+double cross(const vec2 &a, const vec2 &b, const vec2 &c)
+{
+    return (b(0) - a(0)) * (c(1) - a(1)) - (b(1) - a(1)) * (c(0) - a(0));
+}
+
+bool segmentsIntersect(const vec2 &a, const vec2 &b,
+                       const vec2 &c, const vec2 &d)
+{
+    double d1 = cross(c, d, a);
+    double d2 = cross(c, d, b);
+    double d3 = cross(a, b, c);
+    double d4 = cross(a, b, d);
+    return ((d1 > 0) != (d2 > 0)) && ((d3 > 0) != (d4 > 0));
+}
+
+bool polygonOverlapsRect(const Polygon &polygon,
+                         const vec2 &ll, const vec2 &ur)
+{
+    if (polygon.size() < 3)
+        return true;
+    const vec2 corners[4] = { ll, vec2(ur(0), ll(1)),
+                              ur, vec2(ll(0), ur(1)) };
+    // rectangle inside the polygon
+    if (pointInPolygon(polygon, corners[0]))
+        return true;
+    for (uint32 i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        vec2 a = polygonPoint(polygon, i);
+        // polygon inside the rectangle
+        if (a(0) >= ll(0) && a(0) <= ur(0) && a(1) >= ll(1) && a(1) <= ur(1))
+            return true;
+        // crossing edges
+        vec2 b = polygonPoint(polygon, j);
+        for (uint32 k = 0; k < 4; k++)
+            if (segmentsIntersect(a, b, corners[k], corners[(k + 1) % 4]))
+                return true;
+    }
+    return false;
+}
+
+} // namespace
+
+class SeedTaskImpl
+{
+public:
+    typedef std::vector<std::shared_ptr<MetaTile>> MetaTiles;
+
+    struct Node
+    {
+        Node(MapLayer *layer, const NodeInfo &nodeInfo,
+             const std::shared_ptr<const MetaTiles> &parentMetaTiles) :
+            layer(layer), nodeInfo(nodeInfo),
+            parentMetaTiles(parentMetaTiles)
+        {}
+
+        MapLayer *layer;
+        NodeInfo nodeInfo;
+        std::shared_ptr<const MetaTiles> parentMetaTiles;
+    };
+
+    struct Bound
+    {
+        Bound(const BoundInfo *bound, const UrlTemplate::Vars &vars,
+              const std::shared_ptr<BoundMetaTile> &meta) :
+            bound(bound), vars(vars), meta(meta)
+        {}
+
+        const BoundInfo *bound;
+        UrlTemplate::Vars vars;
+        std::shared_ptr<BoundMetaTile> meta;
+    };
+
+    struct Sample
+    {
+        Sample() : total(0), requested(0), measured(0), bytes(0) {}
+
+        uint32 total;
+        uint32 requested;
+        uint32 measured;
+        uint64 bytes;
+    };
+
+    SeedTaskImpl(MapImpl *map, SeedTask *task);
+    bool update(); // returns true when finished
+
+private:
+    bool overlaps(const NodeInfo &nodeInfo);
+    Validity visit(Node &node);
+    void queueNode(const Node &node, const SurfaceInfo *surface,
+                   const vtslibs::vts::MetaNode &meta);
+    void queueBound(const NodeInfo &nodeInfo, const std::string &id);
+    void queue(const std::string &name, FetchTask::ResourceType type,
+               const std::shared_ptr<
+               vtslibs::registry::BoundLayer::Availability> &availTest
+                    = nullptr);
+    void resolveBounds();
+    void collect();
+
+    MapImpl *const map;
+    SeedTask *const task;
+    std::vector<Node> stack; // nodes to visit
+    std::vector<Node> visiting; // nodes waiting for their metatiles
+    std::vector<Bound> bounds; // bound tiles waiting for their metatiles
+    std::vector<std::shared_ptr<Resource>> active; // downloads in progress
+    std::unordered_set<std::string> boundNames; // bound tiles are shared
+    std::map<FetchTask::ResourceType, Sample> samples;
+    float priority;
+};
+
+SeedTaskImpl::SeedTaskImpl(MapImpl *map, SeedTask *task) :
+    map(map), task(task), priority(0)
+{
+    for (auto &it : map->layers)
+    {
+        // monolithic geodata are not tiled
+        if (it->freeLayer && it->freeLayer->type
+                == vtslibs::registry::FreeLayer::Type::geodata)
+            continue;
+        stack.emplace_back(it.get(), it->traverseRoot->nodeInfo, nullptr);
+    }
+}
+
+bool SeedTaskImpl::update()
+{
+    collect();
+    resolveBounds();
+
+    // visit nodes whose metatiles were not available yet
+    {
+        auto it = visiting.begin();
+        while (it != visiting.end())
+        {
+            if (visit(*it) == Validity::Indeterminate)
+                it++;
+            else
+                it = visiting.erase(it);
+        }
+    }
+
+    // start new nodes if there is capacity for their downloads
+    const uint32 maxActive = map->options.maxConcurrentDownloads * 2;
+    while (!stack.empty() && visiting.size() < MaxVisitingNodes
+           && active.size() < maxActive)
+    {
+        Node n = std::move(stack.back());
+        stack.pop_back();
+        if (visit(n) == Validity::Indeterminate)
+            visiting.push_back(std::move(n));
+    }
+
+    // extrapolate the size from the resources measured so far
+    task->bytesEstimated = 0;
+    for (auto &it : samples)
+    {
+        const Sample &s = it.second;
+        if (s.measured)
+            task->bytesEstimated += s.bytes * s.total / s.measured;
+    }
+
+    return stack.empty() && visiting.empty()
+            && bounds.empty() && active.empty();
+}
+
+bool SeedTaskImpl::overlaps(const NodeInfo &nodeInfo)
+{
+    // nodes without srs (eg. the root) cover the whole reference frame
+    if (nodeInfo.srs().empty())
+        return true;
+
+    // node extents in navigation srs
+    vec2 fl = vecFromUblas<vec2>(nodeInfo.extents().ll);
+    vec2 fu = vecFromUblas<vec2>(nodeInfo.extents().ur);
+    const vec2 points[5] = { fl, fu, vec2(fl(0), fu(1)),
+                             vec2(fu(0), fl(1)), (fl + fu) * 0.5 };
+    vec2 ll, ur;
+    try
+    {
+        for (uint32 i = 0; i < 5; i++)
+        {
+            vec2 p = vec3to2(map->convertor->convert(vec2to3(points[i], 0),
+                                    nodeInfo.node(), Srs::Navigation));
+            if (i == 0)
+                ll = ur = p;
+            ll = ll.cwiseMin(p);
+            ur = ur.cwiseMax(p);
+        }
+    }
+    catch (const std::exception &)
+    {
+        return true; // keep nodes that cannot be converted
+    }
+
+    const double *e = task->extents;
+    if (ur(0) < e[0] || ll(0) > e[2] || ur(1) < e[1] || ll(1) > e[3])
+        return false;
+    return polygonOverlapsRect(task->polygon, ll, ur);
+}
+
+Validity SeedTaskImpl::visit(Node &node)
+{
+    MapLayer *layer = node.layer;
+    const TileId nodeId = node.nodeInfo.nodeId();
+    const std::vector<SurfaceInfo> &surfaces = layer->surfaceStack.surfaces;
+    priority = 1.f / (nodeId.lod + 1);
+
+    // find all metatiles, same as travDetermineMeta
+    std::shared_ptr<MetaTiles> metaTiles = std::make_shared<MetaTiles>();
+    metaTiles->resize(surfaces.size());
+    const UrlTemplate::Vars tileIdVars(map->roundId(nodeId));
+    bool determined = true;
+    for (uint32 i = 0, e = metaTiles->size(); i != e; i++)
+    {
+        if (node.parentMetaTiles)
+        {
+            const std::shared_ptr<MetaTile> &p
+                    = (*node.parentMetaTiles)[i];
+            if (!p)
+                continue;
+            TileId pid = vtslibs::vts::parent(nodeId);
+            uint32 idx = (nodeId.x % 2) + (nodeId.y % 2) * 2;
+            const vtslibs::vts::MetaNode &n = p->get(pid);
+            if ((n.flags()
+                 & (vtslibs::vts::MetaNode::Flag::ulChild << idx)) == 0)
+                continue;
+        }
+        const SurfaceInfo &surface = surfaces[i];
+        auto m = map->getMetaTile(ResourceKey(surface.keySource,
+                                         ResourceKey::Slot::MetaTile,
+                                         tileIdVars.tileId),
+                             surface.urlMeta, tileIdVars);
+        m->updatePriority(priority);
+        switch (map->getResourceValidity(m))
+        {
+        case Validity::Indeterminate:
+            determined = false;
+            UTILITY_FALLTHROUGH;
+        case Validity::Invalid:
+            continue;
+        case Validity::Valid:
+            break;
+        }
+        (*metaTiles)[i] = m;
+    }
+    if (!determined)
+        return Validity::Indeterminate;
+
+    // find topmost nonempty surface
+    const SurfaceInfo *topmost = nullptr;
+    const vtslibs::vts::MetaNode *meta = nullptr;
+    bool childsAvailable[4] = {false, false, false, false};
+    for (uint32 i = 0, e = metaTiles->size(); i != e; i++)
+    {
+        if (!(*metaTiles)[i])
+            continue;
+        const vtslibs::vts::MetaNode &n = (*metaTiles)[i]->get(nodeId);
+        for (uint32 i = 0; i < 4; i++)
+            childsAvailable[i] = childsAvailable[i]
+                    || (n.childFlags()
+                        & (vtslibs::vts::MetaNode::Flag::ulChild << i));
+        if (topmost || n.alien() != surfaces[i].alien)
+            continue;
+        if (n.geometry())
+        {
+            meta = &n;
+            if (layer->tilesetStack)
+            {
+                assert(n.sourceReference > 0 && n.sourceReference
+                       <= layer->tilesetStack->surfaces.size());
+                topmost = &layer->tilesetStack->surfaces[n.sourceReference];
+            }
+            else
+                topmost = &surfaces[i];
+        }
+        if (!meta)
+            meta = &n;
+    }
+    if (!meta)
+        return Validity::Invalid;
+
+    task->nodesVisited++;
+    if (topmost && nodeId.lod >= task->lodMin)
+        queueNode(node, topmost, *meta);
+
+    // children
+    if (nodeId.lod < task->lodMax)
+    {
+        vtslibs::vts::Children childs = vtslibs::vts::children(nodeId);
+        for (uint32 i = 0; i < 4; i++)
+        {
+            if (!childsAvailable[i])
+                continue;
+            NodeInfo ni = node.nodeInfo.child(childs[i]);
+            if (overlaps(ni))
+                stack.emplace_back(layer, ni, metaTiles);
+        }
+    }
+
+    return Validity::Valid;
+}
+
+void SeedTaskImpl::queueNode(const Node &node, const SurfaceInfo *surface,
+                             const vtslibs::vts::MetaNode &meta)
+{
+    const TileId nodeId = node.nodeInfo.nodeId();
+    const UrlTemplate::Vars vars(nodeId, vtslibs::vts::local(node.nodeInfo));
+
+    if (node.layer->isGeodata())
+    {
+        queue(surface->urlGeodata(vars),
+              FetchTask::ResourceType::GeodataFeatures);
+        return;
+    }
+
+    queue(surface->urlMesh(vars), FetchTask::ResourceType::Mesh);
+    for (uint32 i = 0; i < meta.internalTextureCount(); i++)
+        queue(surface->urlIntTex(UrlTemplate::Vars(nodeId,
+                        vtslibs::vts::local(node.nodeInfo), i)),
+              FetchTask::ResourceType::Texture);
+
+    // submeshes may reference any of the surfaces of a glue,
+    //   bound layers declared inside the mesh itself are not known
+    //   without decoding it and are skipped
+    uint32 refs = std::max<uint32>(surface->name.size(), 1);
+    for (uint32 r = 1; r <= refs; r++)
+        for (const BoundParamInfo &b : node.layer->boundList(surface, r))
+            queueBound(node.nodeInfo, b.id);
+}
+
+void SeedTaskImpl::queueBound(const NodeInfo &nodeInfo,
+                              const std::string &id)
+{
+    const BoundInfo *bound = map->mapConfig->getBoundInfo(id);
+    if (!bound)
+        return; // external bound layer is not available
+
+    // check lodRange and tileRange, same as BoundParamInfo::prepare
+    {
+        TileId t = nodeInfo.nodeId();
+        int m = bound->lodRange.min;
+        if (t.lod < m)
+            return;
+        t.x >>= t.lod - m;
+        t.y >>= t.lod - m;
+        if (t.x < bound->tileRange.ll[0] || t.x > bound->tileRange.ur[0])
+            return;
+        if (t.y < bound->tileRange.ll[1] || t.y > bound->tileRange.ur[1])
+            return;
+    }
+
+    // nodes deeper than the bound layer use its finest tiles
+    UrlTemplate::Vars vars(nodeInfo.nodeId(), local(nodeInfo));
+    sint32 depth = std::max(nodeInfo.nodeId().lod
+                            - bound->lodRange.max, 0);
+    if (depth > 0)
+    {
+        vars.tileId.lod -= depth;
+        vars.tileId.x >>= depth;
+        vars.tileId.y >>= depth;
+        vars.localId.lod -= depth;
+        vars.localId.x >>= depth;
+        vars.localId.y >>= depth;
+    }
+
+    std::string name = bound->urlExtTex(vars);
+    if (!boundNames.insert(name).second)
+        return;
+
+    if (!bound->metaUrl)
+    {
+        queue(name, FetchTask::ResourceType::Texture, bound->availability);
+        return;
+    }
+
+    // the availability is decided by the bound meta tile
+    UrlTemplate::Vars v(vars);
+    v.tileId.x &= ~255;
+    v.tileId.y &= ~255;
+    v.localId.x &= ~255;
+    v.localId.y &= ~255;
+    std::shared_ptr<BoundMetaTile> bmt = map->getBoundMetaTile(
+                ResourceKey(bound->keySource,
+                            ResourceKey::Slot::BoundMetaTile, v.tileId),
+                bound->urlMeta, v);
+    bmt->updatePriority(priority);
+    bounds.emplace_back(bound, vars, bmt);
+}
+
+void SeedTaskImpl::queue(const std::string &name,
+        FetchTask::ResourceType type,
+        const std::shared_ptr<
+        vtslibs::registry::BoundLayer::Availability> &availTest)
+{
+    Sample &s = samples[type];
+    s.total++;
+    task->resourcesTotal++;
+    if (task->estimateOnly && s.requested >= SamplesPerType)
+        return;
+    s.requested++;
+    std::shared_ptr<Resource> r = map->getSeedResource(name, type);
+    if (availTest && !r->availTest)
+        r->availTest = availTest;
+    r->updatePriority(priority);
+    active.push_back(r);
+}
+
+void SeedTaskImpl::resolveBounds()
+{
+    auto it = bounds.begin();
+    while (it != bounds.end())
+    {
+        switch (map->getResourceValidity(it->meta))
+        {
+        case Validity::Indeterminate:
+            map->touchResource(it->meta);
+            it++;
+            continue;
+        case Validity::Invalid:
+            break;
+        case Validity::Valid:
+        {
+            using vtslibs::registry::BoundLayer;
+            const UrlTemplate::Vars &vars = it->vars;
+            uint8 f = it->meta->flags[(vars.tileId.y & 255) * 256
+                    + (vars.tileId.x & 255)];
+            if ((f & BoundLayer::MetaFlags::available)
+                    != BoundLayer::MetaFlags::available)
+                break;
+            priority = 1.f / (vars.tileId.lod + 1);
+            queue(it->bound->urlExtTex(vars),
+                  FetchTask::ResourceType::Texture,
+                  it->bound->availability);
+            if ((f & BoundLayer::MetaFlags::watertight)
+                    != BoundLayer::MetaFlags::watertight)
+                queue(it->bound->urlMask(vars),
+                      FetchTask::ResourceType::Texture);
+        } break;
+        }
+        it = bounds.erase(it);
+    }
+}
+
+void SeedTaskImpl::collect()
+{
+    uint32 i = 0;
+    while (i < active.size())
+    {
+        const std::shared_ptr<Resource> &r = active[i];
+        Resource::State s = r->state;
+        switch (s)
+        {
+        case Resource::State::ready:
+        case Resource::State::availFail:
+        {
+            task->resourcesDone++;
+            auto sr = std::dynamic_pointer_cast<SeedResource>(r);
+            if (sr && s == Resource::State::ready)
+            {
+                task->bytesDone += sr->size;
+                if (!sr->fetched)
+                    task->resourcesCached++;
+                Sample &sm = samples[r->query.resourceType];
+                sm.measured++;
+                sm.bytes += sr->size;
+            }
+        } break;
+        case Resource::State::errorFatal:
+            task->resourcesFailed++;
+            break;
+        default:
+            map->touchResource(r);
+            i++;
+            continue;
+        }
+        active[i] = std::move(active.back());
+        active.pop_back();
+    }
+}
+
+SeedResource::SeedResource(MapImpl *map, const std::string &name,
+                           FetchTask::ResourceType resourceType) :
+    Resource(map, name, resourceType),
+    size(0), fetched(false)
+{}
+
+void SeedResource::fetchDone()
+{
+    // only resources missing in the cache are fetched
+    fetched = true;
+    Resource::fetchDone();
+}
+
+void SeedResource::load()
+{
+    // the content is already in the cache, it is not kept in memory
+    size = reply.content.size();
+    info.ramMemoryCost += sizeof(*this);
+}
+
+SeedTask::SeedTask(const double extents[4], uint32 lodMin, uint32 lodMax) :
+    extents{extents[0], extents[1], extents[2], extents[3]},
+    lodMin(lodMin), lodMax(lodMax), estimateOnly(false),
+    nodesVisited(0), resourcesTotal(0), resourcesDone(0),
+    resourcesCached(0), resourcesFailed(0),
+    bytesDone(0), bytesEstimated(0), done(false)
+{}
+
+SeedTask::~SeedTask()
+{}
+
+std::shared_ptr<Resource> MapImpl::getSeedResource(const std::string &name,
+        FetchTask::ResourceType resourceType)
+{
+    // the same tile may already be used by the traversal
+    {
+        auto it = resources.resources.find(name);
+        if (it != resources.resources.end())
+        {
+            touchResource(it->second);
+            return it->second;
+        }
+    }
+    // seed resources are not inserted into the resources of the traversal,
+    //   it would find them instead of the meshes and textures it needs
+    std::shared_ptr<SeedResource> &r = resources.seedResources[name];
+    if (!r)
+    {
+        r = std::make_shared<SeedResource>(this, name, resourceType);
+        statistics.resourcesCreated++;
+    }
+    touchResource(r);
+    return r;
+}
+
+void MapImpl::seed(const std::shared_ptr<SeedTask> &task)
+{
+    LOG(info2) << "Seeding lods " << task->lodMin << " - " << task->lodMax;
+    task->impl = std::make_shared<SeedTaskImpl>(this, task.get());
+    resources.seedTasks.push_back(task);
+}
+
+void MapImpl::updateSeeds()
+{
+    auto it = resources.seedTasks.begin();
+    while (it != resources.seedTasks.end())
+    {
+        std::shared_ptr<SeedTask> t = it->lock();
+        if (t && !t->impl->update())
+        {
+            it++;
+            continue;
+        }
+        if (t)
+        {
+            LOG(info2) << "Seeding finished, resources: "
+                       << t->resourcesDone << " done, "
+                       << t->resourcesFailed << " failed";
+            t->impl.reset();
+            t->done = true;
+        }
+        it = resources.seedTasks.erase(it);
+    }
+}
+
+} // namespace vts
@@ -80,7 +80,7 @@ void SriIndex::load()
             bin::read(is, urlBuf.data(), urlBuf.size());
             std::shared_ptr<MetaTile> m = std::make_shared<MetaTile>(map,
                 std::string(urlBuf.data(), urlBuf.size()));
-            map->touchResource(m);
+            m->lastAccessTick = map->renderer.tickIndex;
             bin::read(is, m->reply.expires);
             auto contentStart = is.position();
             *std::dynamic_pointer_cast<vtslibs::vts::MetaTile>(m)
@@ -93,7 +93,9 @@ void SriIndex::load()
                 Buffer buffer(contentEnd - contentStart);
                 memcpy(buffer.data(), reply.content.data() + contentStart,
                        buffer.size());
-                map->resources.cache->write(m->name, buffer, m->reply.expires);
+                map->resources.cache->write(m->name, buffer, m->reply.expires,
+                                            m->query.resourceType,
+                                            CacheValidators());
             }
             m->state = Resource::State::ready;
             metatiles.push_back(m);
@@ -107,7 +109,10 @@ void SriIndex::update()
     for (auto &it : metatiles)
     {
         // inject the metatile into the resources
-        map->resources.resources[it->name] = it;
+        //   unless the metatile is already known
+        if (map->resources.resources.find(it->name)
+                == map->resources.resources.end())
+            map->resourceInsert(it);
     }
     std::vector<std::shared_ptr<MetaTile>>().swap(metatiles);
 }
@@ -48,10 +48,20 @@ std::string MapStatistics::toJson() const
     TJ(metaNodesTraversedTotal, asUInt);
     TJ(resourcesDownloaded, asUInt);
     TJ(resourcesDiskLoaded, asUInt);
+    TJ(resourcesDecodedLoaded, asUInt);
     TJ(resourcesProcessed, asUInt);
     TJ(resourcesCreated, asUInt);
     TJ(resourcesReleased, asUInt);
     TJ(resourcesFailed, asUInt);
+    TJ(resourcesCancelled, asUInt);
+    TJ(resourcesRevalidated, asUInt);
+    TJ(nodesCleared, asUInt);
+    TJ(framesReused, asUInt);
+    TJ(cacheWritesDropped, asUInt);
+    TJ(cacheEntriesEvicted, asUInt);
+    TJ(cacheLookupHits, asUInt);
+    TJ(cacheLookupMisses, asUInt);
+    TJ(cacheLookupFalsePositives, asUInt);
     TJ(renderTicks, asUInt);
     TJ(dataTicks, asUInt);
     TJ(currentGpuMemUseKB, asUInt);
@@ -59,8 +69,16 @@ std::string MapStatistics::toJson() const
     TJ(resourcesActive, asUInt);
     TJ(resourcesDownloading, asUInt);
     TJ(resourcesPreparing, asUInt);
+    TJ(resourcesDecoding, asUInt);
+    TJ(resourcesFetchQueued, asUInt);
+    TJ(currentDataTickMicroseconds, asUInt);
+    TJ(currentDataTickDeferred, asUInt);
+    TJ(cacheWriteQueueDepth, asUInt);
+    TJ(cacheWriteLatencyMicroseconds, asUInt);
+    TJ(cacheDiskUseMB, asUInt);
     TJ(currentNodeMetaUpdates, asUInt);
     TJ(currentNodeDrawsUpdates, asUInt);
+    TJ(currentNodesSwept, asUInt);
     TJE(currentNavigationMode, NavigationMode);
     return jsonToString(v);
 }
@@ -70,10 +88,20 @@ void MapStatistics::resetAll()
     resetFrame();
     resourcesDownloaded = 0;
     resourcesDiskLoaded = 0;
+    resourcesDecodedLoaded = 0;
     resourcesProcessed = 0;
     resourcesCreated = 0;
     resourcesReleased = 0;
     resourcesFailed = 0;
+    resourcesCancelled = 0;
+    resourcesRevalidated = 0;
+    nodesCleared = 0;
+    framesReused = 0;
+    cacheWritesDropped = 0;
+    cacheEntriesEvicted = 0;
+    cacheLookupHits = 0;
+    cacheLookupMisses = 0;
+    cacheLookupFalsePositives = 0;
     renderTicks = 0;
     dataTicks = 0;
     resourcesDownloading = 0;
@@ -81,6 +109,13 @@ void MapStatistics::resetAll()
     currentRamMemUseKB = 0;
     resourcesActive = 0;
     resourcesPreparing = 0;
+    resourcesDecoding = 0;
+    resourcesFetchQueued = 0;
+    currentDataTickMicroseconds = 0;
+    currentDataTickDeferred = 0;
+    cacheWriteQueueDepth = 0;
+    cacheWriteLatencyMicroseconds = 0;
+    cacheDiskUseMB = 0;
     currentNavigationMode = (NavigationMode)0;
 }
 
@@ -88,6 +123,7 @@ void MapStatistics::resetFrame()
 {
     currentNodeMetaUpdates = 0;
     currentNodeDrawsUpdates = 0;
+    currentNodesSwept = 0;
     nodesRenderedTotal = 0;
     metaNodesTraversedTotal = 0;
     for (uint32 i = 0; i < MaxLods; i++)
@@ -217,12 +217,12 @@ void SurfaceStack::generateFree(MapImpl *map,
 }
 
 SurfaceInfo::SurfaceInfo()
-    : color(0,0,0), alien(false)
+    : color(0,0,0), keySource(newResourceKeySource()), alien(false)
 {}
 
 SurfaceInfo::SurfaceInfo(const vtslibs::vts::SurfaceCommonConfig &surface,
                          const std::string &parentPath)
-    : color(0,0,0), alien(false)
+    : color(0,0,0), keySource(newResourceKeySource()), alien(false)
 {
     urlMeta.parse(convertPath(surface.urls3d->meta, parentPath));
     urlMesh.parse(convertPath(surface.urls3d->mesh, parentPath));
@@ -232,7 +232,7 @@ SurfaceInfo::SurfaceInfo(const vtslibs::vts::SurfaceCommonConfig &surface,
 SurfaceInfo::SurfaceInfo(
         const vtslibs::registry::FreeLayer::MeshTiles &surface,
         const std::string &parentPath)
-    : color(0,0,0), alien(false)
+    : color(0,0,0), keySource(newResourceKeySource()), alien(false)
 {
     urlMeta.parse(convertPath(surface.metaUrl, parentPath));
     urlMesh.parse(convertPath(surface.meshUrl, parentPath));
@@ -242,7 +242,7 @@ SurfaceInfo::SurfaceInfo(
 SurfaceInfo::SurfaceInfo(
         const vtslibs::registry::FreeLayer::GeodataTiles &surface,
         const std::string &parentPath)
-    : color(0,0,0), alien(false)
+    : color(0,0,0), keySource(newResourceKeySource()), alien(false)
 {
     urlMeta.parse(convertPath(surface.metaUrl, parentPath));
     urlGeodata.parse(convertPath(surface.geodataUrl, parentPath));
@@ -251,7 +251,7 @@ SurfaceInfo::SurfaceInfo(
 SurfaceInfo::SurfaceInfo(
         const vtslibs::registry::FreeLayer::Geodata &surface,
         const std::string &parentPath)
-    : color(0,0,0), alien(false)
+    : color(0,0,0), keySource(newResourceKeySource()), alien(false)
 {
     urlGeodata.parse(convertPath(surface.geodata, parentPath));
 }
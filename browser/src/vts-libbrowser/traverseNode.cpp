@@ -38,16 +38,130 @@ uint32 hashf(const NodeInfo &node)
     return std::hash<uint32>()(((uint32)id.x << id.lod) + id.y);
 }
 
+static const uint32 BlocksPerChunk = 256;
+
+// all blocks are aligned to this
+static const std::size_t BlockAlignment = 16;
+
+template<class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator(const std::shared_ptr<TraverseNodePool> &pool)
+        : pool(pool)
+    {}
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool(other.pool)
+    {}
+
+    T *allocate(std::size_t n)
+    {
+        return (T*)pool->allocate(sizeof(T) * n);
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        pool->deallocate(p, sizeof(T) * n);
+    }
+
+    template<class U>
+    bool operator == (const PoolAllocator<U> &other) const
+    {
+        return pool == other.pool;
+    }
+
+    template<class U>
+    bool operator != (const PoolAllocator<U> &other) const
+    {
+        return pool != other.pool;
+    }
+
+    // the pool is kept alive by the control blocks of the nodes
+    std::shared_ptr<TraverseNodePool> pool;
+};
+
 } // namespace
 
+TraverseNodePool::TraverseNodePool()
+{}
+
+TraverseNodePool::~TraverseNodePool()
+{}
+
+TraverseNodePool::Blocks &TraverseNodePool::find(std::size_t size)
+{
+    size = (size + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+    for (auto &it : blocks)
+        if (it.size == size)
+            return it;
+    blocks.emplace_back();
+    Blocks &b = blocks.back();
+    b.freeList = nullptr;
+    b.size = size;
+    return b;
+}
+
+void *TraverseNodePool::allocate(std::size_t size)
+{
+    Blocks &b = find(size);
+    if (!b.freeList)
+    {
+        // the blocks of new chunk are linked in order of the addresses
+        char *c = new char[b.size * BlocksPerChunk];
+        b.chunks.emplace_back(c);
+        for (uint32 i = BlocksPerChunk; i-- > 0;)
+        {
+            void *p = c + i * b.size;
+            *(void**)p = b.freeList;
+            b.freeList = p;
+        }
+    }
+    void *p = b.freeList;
+    b.freeList = *(void**)p;
+    return p;
+}
+
+void TraverseNodePool::deallocate(void *ptr, std::size_t size)
+{
+    Blocks &b = find(size);
+    *(void**)ptr = b.freeList;
+    b.freeList = ptr;
+}
+
+TraverseNodeCold *TraverseNodePool::createCold()
+{
+    void *p = allocate(sizeof(TraverseNodeCold));
+    return new (p) TraverseNodeCold();
+}
+
+void TraverseNodePool::destroyCold(TraverseNodeCold *cold)
+{
+    cold->~TraverseNodeCold();
+    deallocate(cold, sizeof(TraverseNodeCold));
+}
+
+std::shared_ptr<TraverseNode> TraverseNode::create(MapLayer *layer,
+                TraverseNode *parent, const NodeInfo &nodeInfo)
+{
+    return std::allocate_shared<TraverseNode>(
+                PoolAllocator<TraverseNode>(layer->traversePool),
+                layer, parent, nodeInfo);
+}
+
 TraverseNode::TraverseNode(vts::MapLayer *layer, TraverseNode *parent,
                            const NodeInfo &nodeInfo)
     : layer(layer), parent(parent),
+      cold(layer->traversePool->createCold()),
       nodeInfo(nodeInfo),
       hash(hashf(nodeInfo)),
+      meta(nullptr),
+      texelSize(std::numeric_limits<double>::infinity()),
       surface(nullptr),
-      lastAccessTime(0), lastRenderTime(0),
-      priority(std::numeric_limits<double>::quiet_NaN())
+      lastAccessTime(0), lastRenderTime(0), visibleTime(0),
+      priority(std::numeric_limits<double>::quiet_NaN()), visible(false)
 {
     // initialize corners to NAN
     {
@@ -56,7 +170,7 @@ TraverseNode::TraverseNode(vts::MapLayer *layer, TraverseNode *parent,
             n[i] = std::numeric_limits<double>::quiet_NaN();
         for (uint32 i = 0; i < 8; i++)
             cornersPhys[i] = n;
-        surrogatePhys = n;
+        cold->surrogatePhys = n;
     }
     // initialize aabb to universe
     {
@@ -68,38 +182,44 @@ TraverseNode::TraverseNode(vts::MapLayer *layer, TraverseNode *parent,
 }
 
 TraverseNode::~TraverseNode()
-{}
+{
+    // the children are released first, while the pool is in use
+    childs.clear();
+    layer->traversePool->destroyCold(cold);
+}
 
 void TraverseNode::clearAll()
 {
     childs.clear();
-    metaTiles.clear();
-    meta.reset();
+    cold->metaTiles.clear();
+    cold->meta.reset();
+    meta = nullptr;
     obb.reset();
-    surrogatePhys.reset();
-    surrogateNav.reset();
+    texelSize = std::numeric_limits<double>::infinity();
+    cold->surrogatePhys.reset();
+    cold->surrogateNav.reset();
     surface = nullptr;
-    credits.clear();
+    cold->credits.clear();
     clearRenders();
 }
 
 void TraverseNode::clearRenders()
 {
-    opaque.clear();
-    transparent.clear();
-    geodata.clear();
-    touchResource.reset();
+    cold->opaque.clear();
+    cold->transparent.clear();
+    cold->geodata.clear();
+    cold->touchResource.reset();
 }
 
 bool TraverseNode::rendersReady() const
 {
-    for (auto &it : opaque)
+    for (auto &it : cold->opaque)
         if (!it.ready())
             return false;
-    for (auto &it : transparent)
+    for (auto &it : cold->transparent)
         if (!it.ready())
             return false;
-    for (auto &it : geodata)
+    for (auto &it : cold->geodata)
         if (!it.ready())
             return false;
     return true;
@@ -107,7 +227,8 @@ bool TraverseNode::rendersReady() const
 
 bool TraverseNode::rendersEmpty() const
 {
-    return opaque.empty() && transparent.empty() && geodata.empty();
+    return cold->opaque.empty() && cold->transparent.empty()
+            && cold->geodata.empty();
 }
 
 } // namespace vts